@@ -0,0 +1,399 @@
+/*
+* SchedulerBench.cpp
+* Measures the scheduler's hot paths natively, built in a few configurations by bench/CMakeLists.txt
+*
+* dispatch: ns per run(), with N processes spread over the priority levels, some
+*   SERVICE_CONSTANTLY and the rest with a period of 1, and how many of those runs serviced something
+* until_idle: the same with runUntilIdle(), ns per pass (divide by dispatches / ops for per process)
+* drain: ns per queued operation (a disable()) when run() empties the job queue
+* add: ns per add(), including draining it from the job queue
+* find: ns per findProcById(), from the id table
+* list_walk_add, list_walk_find: the baseline from before the id table, which walked a linked list
+*   per priority level. list_walk_add is only that walking (already added? free id? tail?),
+*   the old add() cost about that on top of the rest of add()
+*
+* usage: bench_<config> [--csv file] [--json file] [--runs n]
+* With neither file, CSV goes to stdout
+*/
+
+#include <ProcessScheduler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#ifndef BENCH_CONFIG
+#define BENCH_CONFIG "default"
+#endif
+
+class BenchProcess final : public Process
+{
+public:
+    BenchProcess(Scheduler &manager, ProcPriority pr, uint32_t period)
+        :  Process(manager, pr, period, RUNTIME_FOREVER) {}
+
+    static uint32_t services;
+
+protected:
+    virtual void service() { services++; }
+};
+
+uint32_t BenchProcess::services = 0;
+
+
+struct Result
+{
+    const char *bench;
+    int processes;
+    int levels;
+    int constantPct;
+    uint32_t ops;
+    double nsPerOp;
+    uint32_t dispatches;
+};
+
+static std::vector<Result> results;
+// Lookups add up their results here, so they are not optimized away
+static volatile uint32_t sink = 0;
+static uint32_t runs = 20000;
+
+static const int counts[] = { 1, 2, 4, 8, 16, 32, 64, 128, SCHEDULER_MAX_PROCESSES };
+static const int constantPcts[] = { 100, 50, 0 };
+
+// Keep within the job queue, add(true) takes two slots
+#define CHUNK (SCHEDULER_JOB_QUEUE_SIZE / 2)
+
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Spread evenly, so 50% of 3 is 1 and 50% of 4 is 2
+static bool isConstant(int i, int constantPct)
+{
+    return (i + 1) * constantPct / 100 > i * constantPct / 100;
+}
+
+static void spawn(Scheduler &sched, std::vector<BenchProcess *> &procs, int count,
+        int levels, int constantPct, uint32_t period, bool enable)
+{
+    for (int i = 0; i < count; i++) {
+        ProcPriority pr = static_cast<ProcPriority>(i % levels);
+        BenchProcess *p = new BenchProcess(sched, pr, isConstant(i, constantPct) ? SERVICE_CONSTANTLY : period);
+        procs.push_back(p);
+        p->add(enable);
+
+        if ((i + 1) % CHUNK == 0)
+            sched.run();
+    }
+    sched.run();
+}
+
+static void teardown(Scheduler &sched, std::vector<BenchProcess *> &procs)
+{
+    for (size_t i = 0; i < procs.size(); i++) {
+        procs[i]->destroy();
+        if ((i + 1) % CHUNK == 0)
+            sched.run();
+    }
+    sched.run();
+
+    for (size_t i = 0; i < procs.size(); i++)
+        delete procs[i];
+    procs.clear();
+}
+
+
+static void benchDispatch(Scheduler &sched, int count, int levels, int constantPct, bool untilIdle = false)
+{
+    std::vector<BenchProcess *> procs;
+    spawn(sched, procs, count, levels, constantPct, 1, true);
+
+    // Warm up
+    for (uint32_t i = 0; i < runs / 10; i++)
+        sched.run();
+
+    uint32_t dispatches = 0;
+    uint64_t start = nowNs();
+    for (uint32_t i = 0; i < runs; i++)
+        dispatches += untilIdle ? sched.runUntilIdle() : sched.run();
+    uint64_t elapsed = nowNs() - start;
+
+    Result r = { untilIdle ? "until_idle" : "dispatch", count, levels, constantPct, runs, (double)elapsed / runs, dispatches };
+    results.push_back(r);
+
+    teardown(sched, procs);
+}
+
+static void benchDrain(Scheduler &sched, int count)
+{
+    std::vector<BenchProcess *> procs;
+    // Never due again once they ran, so run() only drains the queue
+    spawn(sched, procs, count, NUM_PRIORITY_LEVELS, 0, 0x7FFFFFFF, true);
+
+    uint32_t ops = 0;
+    uint64_t elapsed = 0;
+    while (ops < runs) {
+        for (int first = 0; first < count; first += SCHEDULER_JOB_QUEUE_SIZE) {
+            int last = first + SCHEDULER_JOB_QUEUE_SIZE < count ? first + SCHEDULER_JOB_QUEUE_SIZE : count;
+            for (int i = first; i < last; i++)
+                procs[i]->disable();
+
+            uint64_t start = nowNs();
+            sched.run();
+            elapsed += nowNs() - start;
+            ops += last - first;
+        }
+
+        // Back to where they were, not timed
+        for (int i = 0; i < count; i++) {
+            procs[i]->enable();
+            if ((i + 1) % SCHEDULER_JOB_QUEUE_SIZE == 0)
+                sched.run();
+        }
+        sched.run();
+    }
+
+    Result r = { "drain", count, NUM_PRIORITY_LEVELS, 0, ops, (double)elapsed / ops, 0 };
+    results.push_back(r);
+
+    teardown(sched, procs);
+}
+
+static void benchAdd(Scheduler &sched, int count)
+{
+    std::vector<BenchProcess *> procs;
+    for (int i = 0; i < count; i++)
+        procs.push_back(new BenchProcess(sched, static_cast<ProcPriority>(i % NUM_PRIORITY_LEVELS), 1));
+
+    uint32_t ops = 0;
+    uint64_t elapsed = 0;
+    while (ops < runs) {
+        uint64_t start = nowNs();
+        for (int i = 0; i < count; i++) {
+            procs[i]->add();
+            if ((i + 1) % SCHEDULER_JOB_QUEUE_SIZE == 0)
+                sched.run();
+        }
+        sched.run();
+        elapsed += nowNs() - start;
+        ops += count;
+
+        // Not timed
+        for (int i = 0; i < count; i++) {
+            procs[i]->destroy();
+            if ((i + 1) % SCHEDULER_JOB_QUEUE_SIZE == 0)
+                sched.run();
+        }
+        sched.run();
+    }
+
+    Result r = { "add", count, NUM_PRIORITY_LEVELS, 0, ops, (double)elapsed / ops, 0 };
+    results.push_back(r);
+
+    for (int i = 0; i < count; i++)
+        delete procs[i];
+}
+
+
+static void benchFind(Scheduler &sched, int count)
+{
+    std::vector<BenchProcess *> procs;
+    spawn(sched, procs, count, NUM_PRIORITY_LEVELS, 0, 0x7FFFFFFF, true);
+
+    uint32_t ops = 0;
+    uint32_t found = 0;
+    uint64_t start = nowNs();
+    while (ops < runs) {
+        for (int i = 0; i < count; i++)
+            found += sched.findProcById(procs[i]->getID()) == procs[i];
+        ops += count;
+    }
+    uint64_t elapsed = nowNs() - start;
+
+    sink += found;
+
+    Result r = { "find", count, NUM_PRIORITY_LEVELS, 0, ops, (double)elapsed / ops, 0 };
+    results.push_back(r);
+
+    teardown(sched, procs);
+}
+
+
+// The process list before the id table, only what add() and findProcById() went through
+struct ListNode
+{
+    uint8_t id;
+    uint8_t priority;
+    ListNode *next;
+};
+
+class ListWalk
+{
+public:
+    ListWalk() : _lastID(0) { memset(_heads, 0, sizeof(_heads)); }
+
+    ListNode *findById(uint8_t id)
+    {
+        for (uint8_t i = 0; i < NUM_PRIORITY_LEVELS; i++)
+        {
+            for (ListNode *node = _heads[i]; node != NULL; node = node->next)
+            {
+                if (node->id == id)
+                    return node;
+            }
+        }
+        return NULL;
+    }
+
+    void add(ListNode &node)
+    {
+        for (ListNode *p = _heads[node.priority]; p != NULL; p = p->next)
+        {
+            if (p == &node)
+                return;
+        }
+
+        for (; node.id == 0 || findById(node.id) != NULL; node.id = ++_lastID); // Find a free id
+
+        node.next = NULL;
+        if (!_heads[node.priority]) {
+            _heads[node.priority] = &node;
+        } else {
+            ListNode *tail = _heads[node.priority];
+            for (; tail->next; tail = tail->next);
+            tail->next = &node;
+        }
+    }
+
+    void clear()
+    {
+        memset(_heads, 0, sizeof(_heads));
+    }
+
+private:
+    ListNode *_heads[NUM_PRIORITY_LEVELS];
+    uint8_t _lastID;
+};
+
+static void benchListWalk(int count)
+{
+    std::vector<ListNode> nodes(count);
+    ListWalk list;
+
+    uint32_t ops = 0;
+    uint64_t elapsed = 0;
+    while (ops < runs) {
+        list.clear();
+        for (int i = 0; i < count; i++) {
+            nodes[i].id = 0;
+            nodes[i].priority = i % NUM_PRIORITY_LEVELS;
+        }
+
+        uint64_t start = nowNs();
+        for (int i = 0; i < count; i++)
+            list.add(nodes[i]);
+        elapsed += nowNs() - start;
+        ops += count;
+    }
+
+    Result r = { "list_walk_add", count, NUM_PRIORITY_LEVELS, 0, ops, (double)elapsed / ops, 0 };
+    results.push_back(r);
+
+    ops = 0;
+    uint32_t found = 0;
+    uint64_t start = nowNs();
+    while (ops < runs) {
+        for (int i = 0; i < count; i++)
+            found += list.findById(nodes[i].id) == &nodes[i];
+        ops += count;
+    }
+    elapsed = nowNs() - start;
+
+    sink += found;
+
+    Result f = { "list_walk_find", count, NUM_PRIORITY_LEVELS, 0, ops, (double)elapsed / ops, 0 };
+    results.push_back(f);
+}
+
+
+static void writeCsv(FILE *out)
+{
+    fprintf(out, "config,bench,processes,levels,constant_pct,ops,ns_per_op,dispatches\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        fprintf(out, "%s,%s,%d,%d,%d,%u,%.1f,%u\n", BENCH_CONFIG, r.bench, r.processes,
+            r.levels, r.constantPct, (unsigned)r.ops, r.nsPerOp, (unsigned)r.dispatches);
+    }
+}
+
+static void writeJson(FILE *out)
+{
+    fprintf(out, "{\n  \"config\": \"%s\",\n  \"results\": [\n", BENCH_CONFIG);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+        fprintf(out, "    {\"bench\": \"%s\", \"processes\": %d, \"levels\": %d, \"constant_pct\": %d, "
+            "\"ops\": %u, \"ns_per_op\": %.1f, \"dispatches\": %u}%s\n", r.bench, r.processes,
+            r.levels, r.constantPct, (unsigned)r.ops, r.nsPerOp, (unsigned)r.dispatches,
+            i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+static bool writeFile(const char *path, void (*writer)(FILE *))
+{
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        fprintf(stderr, "Can not open %s\n", path);
+        return false;
+    }
+    writer(out);
+    fclose(out);
+    return true;
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *csvPath = NULL;
+    const char *jsonPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csvPath = argv[++i];
+        } else if (!strcmp(argv[i], "--json") && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+            runs = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--csv file] [--json file] [--runs n]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    Scheduler sched;
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        for (size_t m = 0; m < sizeof(constantPcts) / sizeof(constantPcts[0]); m++) {
+            benchDispatch(sched, counts[c], 1, constantPcts[m]);
+            benchDispatch(sched, counts[c], NUM_PRIORITY_LEVELS, constantPcts[m]);
+            benchDispatch(sched, counts[c], NUM_PRIORITY_LEVELS, constantPcts[m], true);
+        }
+        benchDrain(sched, counts[c]);
+        benchAdd(sched, counts[c]);
+        benchFind(sched, counts[c]);
+        benchListWalk(counts[c]);
+    }
+
+    bool ok = true;
+    if (csvPath)
+        ok &= writeFile(csvPath, writeCsv);
+    if (jsonPath)
+        ok &= writeFile(jsonPath, writeJson);
+    if (!csvPath && !jsonPath)
+        writeCsv(stdout);
+
+    return ok ? 0 : 1;
+}
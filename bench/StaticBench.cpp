@@ -0,0 +1,154 @@
+/*
+* StaticBench.cpp
+* Compares StaticScheduler against Scheduler natively, for the same set of processes
+*
+* dispatch: ns per run(), with N SERVICE_CONSTANTLY processes at one priority level
+* bytes: RAM per process, the process object plus whatever the scheduler keeps on it
+*   (for Scheduler that includes the vtable pointer and its slot in the id table)
+* Flash can only be compared on the board, build a sketch both ways and compare avr-size
+*
+* usage: bench_static [--csv file] [--runs n]
+* Without a file, CSV goes to stdout
+*/
+
+#include <ProcessScheduler.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+class DynamicBenchProcess final : public Process
+{
+public:
+    DynamicBenchProcess(Scheduler &manager)
+        :  Process(manager, HIGH_PRIORITY, SERVICE_CONSTANTLY, RUNTIME_FOREVER) {}
+
+    static uint32_t services;
+
+protected:
+    virtual void service() { services++; }
+};
+
+uint32_t DynamicBenchProcess::services = 0;
+
+struct StaticBenchProcess : StaticProcess<StaticBenchProcess>
+{
+    static const ProcPriority PRIORITY = HIGH_PRIORITY;
+
+    static uint32_t services;
+
+    void service() { services++; }
+};
+
+uint32_t StaticBenchProcess::services = 0;
+
+// StaticScheduler<StaticBenchProcess, ...> with N of them
+template <int N, class... Procs>
+struct RepeatStatic
+{
+    typedef typename RepeatStatic<N - 1, StaticBenchProcess, Procs...>::type type;
+};
+
+template <class... Procs>
+struct RepeatStatic<0, Procs...>
+{
+    typedef StaticScheduler<Procs...> type;
+};
+
+
+static uint32_t runs = 200000;
+static FILE *out = stdout;
+
+
+static uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+template <class Sched>
+static double timeRuns(Sched &sched)
+{
+    // Warm up
+    for (uint32_t i = 0; i < runs / 10; i++)
+        sched.run();
+
+    uint64_t start = nowNs();
+    for (uint32_t i = 0; i < runs; i++)
+        sched.run();
+    return (double)(nowNs() - start) / runs;
+}
+
+static double benchDynamic(int count)
+{
+    Scheduler sched;
+    DynamicBenchProcess *procs[SCHEDULER_MAX_PROCESSES];
+    for (int i = 0; i < count; i++) {
+        procs[i] = new DynamicBenchProcess(sched);
+        procs[i]->add(true);
+        sched.run();
+    }
+
+    double ns = timeRuns(sched);
+
+    for (int i = 0; i < count; i++) {
+        procs[i]->destroy();
+        sched.run();
+        delete procs[i];
+    }
+    return ns;
+}
+
+template <int N>
+static void bench()
+{
+    typedef typename RepeatStatic<N>::type Sched;
+
+    Sched *sched = new Sched();
+    sched->begin();
+    double staticNs = timeRuns(*sched);
+    sched->end();
+    delete sched;
+
+    double dynamicNs = benchDynamic(N);
+
+    size_t dynamicBytes = sizeof(DynamicBenchProcess) + sizeof(Process *);
+    size_t staticBytes = (sizeof(Sched) + N - 1) / N;
+
+    fprintf(out, "%d,%.1f,%.1f,%u,%u\n", N, dynamicNs, staticNs,
+        (unsigned)dynamicBytes, (unsigned)staticBytes);
+}
+
+
+int main(int argc, char **argv)
+{
+    const char *csvPath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--csv") && i + 1 < argc) {
+            csvPath = argv[++i];
+        } else if (!strcmp(argv[i], "--runs") && i + 1 < argc) {
+            runs = strtoul(argv[++i], NULL, 10);
+        } else {
+            fprintf(stderr, "usage: %s [--csv file] [--runs n]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (csvPath && !(out = fopen(csvPath, "w"))) {
+        fprintf(stderr, "Can not open %s\n", csvPath);
+        return 1;
+    }
+
+    fprintf(out, "processes,dynamic_ns_per_run,static_ns_per_run,dynamic_bytes_per_process,static_bytes_per_process\n");
+    bench<1>();
+    bench<2>();
+    bench<4>();
+    bench<8>();
+    bench<16>();
+    bench<32>();
+
+    if (out != stdout)
+        fclose(out);
+    return 0;
+}
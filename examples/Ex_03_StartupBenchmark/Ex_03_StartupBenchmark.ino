@@ -0,0 +1,82 @@
+/*
+* Example 03: Ex_03_StartupBenchmark.ino
+*
+* In this example we time how long it takes the scheduler to add and enable a lot of processes,
+* and then how long it takes to look each one of them up by id
+* NOTE: Only SCHEDULER_MAX_PROCESSES processes can be added at once,
+* raise it in Config.h to benchmark all 250 (a board with enough RAM is needed)
+* bench/SchedulerBench.cpp compares this against walking the process lists, as it used to
+*/
+
+#include <ProcessScheduler.h>
+
+// An Uno only has 2 KB of RAM, each process takes about 50 bytes
+#if defined(RAMEND) && RAMEND < 0x900
+#define NUM_PROCESSES 16
+#else
+#define NUM_PROCESSES 250
+#endif
+
+// A process that does nothing, we only care about the scheduler overhead
+class NopProcess : public Process
+{
+public:
+    NopProcess(Scheduler &manager, ProcPriority pr)
+        :  Process(manager, pr, SERVICE_SECONDLY) {}
+
+protected:
+    virtual void service() {}
+};
+
+Scheduler sched; // Create a global Scheduler object
+
+void setup()
+{
+    Serial.begin(9600);
+
+    uint8_t count = NUM_PROCESSES < SCHEDULER_MAX_PROCESSES ? NUM_PROCESSES : SCHEDULER_MAX_PROCESSES;
+    NopProcess *procs[SCHEDULER_MAX_PROCESSES];
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        procs[i] = new NopProcess(sched, (ProcPriority)(i % NUM_PRIORITY_LEVELS));
+        // Out of RAM, benchmark the ones we have
+        if (!procs[i]) {
+            count = i;
+            break;
+        }
+    }
+
+    // Time adding them, run() empties the job queue
+    uint32_t start = micros();
+    for (uint8_t i = 0; i < count; i++)
+    {
+        procs[i]->add(true);
+        sched.run();
+    }
+    uint32_t addTime = micros() - start;
+
+    // Time looking each one up
+    start = micros();
+    uint8_t found = 0;
+    for (uint8_t i = 0; i < count; i++)
+        found += sched.findProcById(procs[i]->getID()) == procs[i] && procs[i]->isNotDestroyed();
+    uint32_t findTime = micros() - start;
+
+    Serial.print("Added ");
+    Serial.print(sched.countProcesses());
+    Serial.print(" processes in ");
+    Serial.print(addTime);
+    Serial.println(" us");
+
+    Serial.print("Found ");
+    Serial.print(found);
+    Serial.print(" processes by id in ");
+    Serial.print(findTime);
+    Serial.println(" us");
+}
+
+void loop()
+{
+    sched.run();
+}
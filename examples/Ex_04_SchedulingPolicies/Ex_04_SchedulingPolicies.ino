@@ -0,0 +1,84 @@
+/*
+* Example 04: Ex_04_SchedulingPolicies.ino
+*
+* In this example we run the same busy workload under three scheduling policies
+* and count how many times a process finishes after its deadline (its next release)
+*
+* The workload keeps the processor 80% busy. The priorities are picked by importance,
+* not by period, which is what trips up the default fixed priority policy.
+* Rate monotonic ignores them and goes by period, earliest deadline first goes by deadline
+* NOTE: Processes can't be interrupted, so every service() has to be shorter than the
+* slack of the fastest process, or no policy can keep it on time
+*/
+
+#include <ProcessScheduler.h>
+
+#define TRIAL_LENGTH 10000 // ms
+
+// Pretends to do some work that takes cost ms, then checks whether it was late
+class WorkProcess : public Process
+{
+public:
+    WorkProcess(Scheduler &manager, ProcPriority pr, uint32_t period, uint32_t cost)
+        :  Process(manager, pr, period), _cost(cost), _misses(0) {}
+
+    uint16_t getMisses() { return _misses; }
+
+protected:
+    virtual void service()
+    {
+        delay(_cost);
+
+        // It was released at getScheduledTS(), and had to be done one period later
+        if (Scheduler::getCurrTS() - getScheduledTS() > getPeriod())
+            _misses++;
+    }
+
+private:
+    uint32_t _cost;
+    uint16_t _misses;
+};
+
+
+template <class SchedulerType>
+uint16_t runTrial()
+{
+    SchedulerType sched;
+    WorkProcess fast(sched, LOW_PRIORITY, 20, 5);
+    WorkProcess medium(sched, MEDIUM_PRIORITY, 50, 15);
+    WorkProcess slow(sched, HIGH_PRIORITY, 100, 25);
+    WorkProcess *procs[] = {&fast, &medium, &slow};
+
+    for (uint8_t i = 0; i < 3; i++)
+        procs[i]->add(true);
+
+    uint32_t start = millis();
+    while (millis() - start < TRIAL_LENGTH)
+        sched.runOrSleep();
+
+    uint16_t misses = 0;
+    for (uint8_t i = 0; i < 3; i++) {
+        misses += procs[i]->getMisses();
+        procs[i]->destroy();
+    }
+    sched.run(); // Empty the job queue before it goes out of scope
+
+    return misses;
+}
+
+
+void setup()
+{
+    Serial.begin(9600);
+
+    Serial.print("Fixed priority deadline misses: ");
+    Serial.println(runTrial<Scheduler>());
+
+    Serial.print("Rate monotonic deadline misses: ");
+    Serial.println(runTrial<PolicyScheduler<RateMonotonicPolicy> >());
+
+    Serial.print("Earliest deadline first deadline misses: ");
+    Serial.println(runTrial<PolicyScheduler<EdfPolicy> >());
+}
+
+void loop() {}
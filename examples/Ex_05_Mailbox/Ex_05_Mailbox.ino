@@ -0,0 +1,86 @@
+/*
+* Example 05: Ex_05_Mailbox.ino
+*
+* In this example a button interrupt hands each press over to a process through a Mailbox
+* The process has a period of SERVICE_ON_EVENT, so it is only serviced when a press arrives,
+* right on the next run(), instead of checking a global every so often
+*
+* Connect a button between pin 2 and ground, and open the Serial Monitor
+*/
+
+#include <ProcessScheduler.h>
+
+#define BUTTON_PIN 2
+#define MAILBOX_SIZE 8
+
+// The ESP8266 needs interrupt handlers in RAM, AVR has nothing like it
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+struct Press
+{
+    uint32_t ts;
+    uint16_t count;
+};
+
+// Only the pointers go through the mailbox, so the presses need somewhere to live
+// At most MAILBOX_SIZE are waiting, and one more is being printed
+Press presses[MAILBOX_SIZE + 1];
+uint8_t nextPress = 0;
+uint16_t pressCount = 0;
+
+
+class PrintPressProcess : public Process
+{
+public:
+    PrintPressProcess(Scheduler &manager, ProcPriority pr)
+        :  Process(manager, pr, SERVICE_ON_EVENT), mailbox(*this) {}
+
+    Mailbox<Press, MAILBOX_SIZE> mailbox;
+
+protected:
+    virtual void service()
+    {
+        // Take everything, it is woken up again for anything sent after
+        while (Press *press = mailbox.receive())
+        {
+            Serial.print("Press #");
+            Serial.print(press->count);
+            Serial.print(" at ");
+            Serial.print(press->ts);
+            Serial.print(" ms, printed ");
+            Serial.print(millis() - press->ts);
+            Serial.println(" ms later");
+        }
+    }
+};
+
+Scheduler sched;
+PrintPressProcess printer(sched, HIGH_PRIORITY);
+
+
+void IRAM_ATTR onPress()
+{
+    Press *press = &presses[nextPress];
+    press->ts = millis();
+    press->count = ++pressCount;
+
+    // Only move on to the next one if it was sent, otherwise the mailbox is full
+    if (printer.mailbox.send(press))
+        nextPress = (nextPress + 1) % (MAILBOX_SIZE + 1);
+}
+
+void setup()
+{
+    Serial.begin(9600);
+    pinMode(BUTTON_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), onPress, FALLING);
+
+    printer.add(true);
+}
+
+void loop()
+{
+    sched.runOrSleep();
+}
@@ -0,0 +1,72 @@
+/*
+* Example 06: Ex_06_StaticBlink.ino
+*
+* The same blinking as Ex_02_MultiBlink, with a StaticScheduler instead
+* The processes are known when compiling, so there are no virtual methods and nothing is
+* allocated at run time, which saves RAM and flash. The pin and period are template arguments
+* - Blink<13, 250> (pin 13)
+* - Blink<12, 500> (pin 12)
+* - Blink<11, 1000> (pin 11)
+* Connect an LED to each of these pins and watch them blink
+*/
+
+#include <ProcessScheduler.h>
+
+template <uint8_t PIN, uint32_t BLINK_PERIOD>
+class Blink : public StaticProcess<Blink<PIN, BLINK_PERIOD> >
+{
+public:
+    static const ProcPriority PRIORITY = HIGH_PRIORITY;
+    static const uint32_t PERIOD = BLINK_PERIOD;
+
+    // The hooks are called directly by the scheduler, so they are public and not virtual
+    void setup()
+    {
+      pinMode(PIN, OUTPUT);
+      _pinState = LOW;
+      digitalWrite(PIN, _pinState);
+    }
+
+    void cleanup()
+    {
+      pinMode(PIN, INPUT);
+      _pinState = LOW;
+    }
+
+    //LEDs should be off when disabled
+    void onDisable()
+    {
+      _pinState = LOW;
+      digitalWrite(PIN, _pinState);
+    }
+
+    //Start the LEDs on
+    void onEnable()
+    {
+      _pinState = HIGH;
+      digitalWrite(PIN, _pinState);
+    }
+
+    void service()
+    {
+      // If pin is on turn it off, otherwise turn it on
+      _pinState = !_pinState;
+      digitalWrite(PIN, _pinState);
+    }
+
+private:
+    bool _pinState; //the Current state of the pin
+};
+
+StaticScheduler<Blink<13, 250>, Blink<12, 500>, Blink<11, 1000> > sched;
+
+void setup()
+{
+  // setup() and enable() every process
+  sched.begin();
+}
+
+void loop()
+{
+    sched.run();
+}
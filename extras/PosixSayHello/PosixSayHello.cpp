@@ -0,0 +1,45 @@
+/*
+* PosixSayHello.cpp
+* Example 01 as a normal Linux program, build it with the CMakeLists.txt at the top of the library
+*
+* Two processes say hello at different periods, once the slow one is done everything halts
+* Between runs the scheduler sleeps instead of spinning, see runOrSleep()
+*/
+
+#include <ProcessScheduler.h>
+#include <stdio.h>
+
+class SayHelloProcess : public Process
+{
+public:
+    SayHelloProcess(Scheduler &manager, ProcPriority pr, unsigned int period, int iterations)
+        :  Process(manager, pr, period, iterations) {}
+
+protected:
+    virtual void service()
+    {
+        printf("%u ms: Hello from Process: %d\n", (unsigned)Scheduler::getCurrTS(), getID());
+    }
+};
+
+Scheduler sched;
+
+SayHelloProcess fastProc(sched, HIGH_PRIORITY, 250, RUNTIME_FOREVER);
+SayHelloProcess slowProc(sched, LOW_PRIORITY, 1000, 5);
+
+int main()
+{
+    fastProc.add(true);
+    slowProc.add(true);
+    sched.run(); // Take care of the queued add()s
+
+    // The slow one disables itself after its 5 iterations
+    while (slowProc.isEnabled())
+        sched.runOrSleep();
+
+    // Destroys every process, on POSIX run() then just returns
+    sched.halt();
+    sched.run();
+
+    return 0;
+}
@@ -0,0 +1,80 @@
+/*
+* Simulation.cpp
+* Replays a day of scheduling in a few seconds with a VirtualClock (needs _PROCESS_CUSTOM_CLOCK)
+*
+* A fast sensor process, a control loop, and a logger that every so often takes far longer
+* than usual. Each service() is charged a modeled run time instead of actually taking it,
+* and the clock jumps straight to the next deadline in between
+* Try changing the periods and costs to see when the sensor starts falling behind
+*/
+
+#include <ProcessScheduler.h>
+#include <stdio.h>
+
+#define SIM_DAY (24UL * 60 * 60 * 1000)
+
+class SimProcess : public Process
+{
+public:
+    SimProcess(Scheduler &manager, ProcPriority pr, uint32_t period, uint32_t cost,
+            uint32_t slowCost = 0, uint32_t slowEvery = 0)
+        :  Process(manager, pr, period, RUNTIME_FOREVER, 3),
+        cost(cost), slowCost(slowCost), slowEvery(slowEvery), services(0), warnings(0) {}
+
+    // How long this service() takes
+    uint32_t modeledRunTime()
+    {
+        if (slowEvery && services % slowEvery == 0)
+            return slowCost;
+        return cost;
+    }
+
+    uint32_t cost, slowCost, slowEvery;
+    uint32_t services, warnings;
+
+protected:
+    virtual void service() { services++; }
+
+    virtual void handleWarning(ProcessWarning warning)
+    {
+        if (warning == WARNING_PROC_OVERSCHEDULED)
+            warnings++;
+    }
+};
+
+static uint32_t modelRunTime(Process &process)
+{
+    return static_cast<SimProcess &>(process).modeledRunTime();
+}
+
+Scheduler sched;
+
+SimProcess sensor(sched, HIGH_PRIORITY, 10, 1);
+SimProcess control(sched, MEDIUM_PRIORITY, 100, 5);
+// Usually quick, but every 600th write (10 minutes) flushes for 40 ms
+SimProcess logger(sched, LOW_PRIORITY, 1000, 2, 40, 600);
+
+int main()
+{
+    // Start close to wrapping around, so the day crosses it
+    VirtualClock clock(0xFFFFFFFF - SIM_DAY / 2);
+    clock.setRunTimeModel(modelRunTime);
+    Scheduler::setClock(&clock);
+
+    sensor.add(true);
+    control.add(true);
+    logger.add(true);
+
+    uint32_t serviced = clock.simulate(sched, SIM_DAY);
+
+    printf("Simulated %lu ms, %lu services\n", SIM_DAY, (unsigned long)serviced);
+    SimProcess *procs[] = { &sensor, &control, &logger };
+    const char *names[] = { "sensor", "control", "logger" };
+    for (int i = 0; i < 3; i++) {
+        printf("%-8s period %4lu ms: %8lu services (expected %8lu), %lu overscheduled warnings\n",
+            names[i], (unsigned long)procs[i]->getPeriod(), (unsigned long)procs[i]->services,
+            SIM_DAY / procs[i]->getPeriod(), (unsigned long)procs[i]->warnings);
+    }
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+* TraceExport.cpp
+* Records a couple of seconds of scheduling into trace.bin (needs _PROCESS_TRACE)
+*
+* A fast process, a slow one that sometimes takes too long, and one that raises an exception
+* every so often. Then turn the dump into a timeline for chrome://tracing or ui.perfetto.dev:
+*   python3 trace2json.py trace.bin -o trace.json --names 1=fast,2=slow,3=flaky
+* On a board, Serial.write() the records instead, and capture them to a file
+*/
+
+#include <ProcessScheduler.h>
+#include <stdio.h>
+#include <unistd.h>
+
+class WorkProcess : public Process
+{
+public:
+    WorkProcess(Scheduler &manager, ProcPriority pr, uint32_t period, uint32_t work,
+            uint32_t slowWork = 0, uint32_t slowEvery = 0, int throwEvery = 0)
+        :  Process(manager, pr, period, RUNTIME_FOREVER, 3),
+        work(work), slowWork(slowWork), slowEvery(slowEvery), throwEvery(throwEvery), services(0) {}
+
+protected:
+    virtual void service()
+    {
+        services++;
+        if (throwEvery && services % throwEvery == 0)
+            raiseException(services);
+
+        // Pretend to be busy
+        usleep(1000 * (slowEvery && services % slowEvery == 0 ? slowWork : work));
+    }
+
+    virtual bool handleException(int) { return true; }
+
+    uint32_t work, slowWork, slowEvery;
+    int throwEvery;
+    uint32_t services;
+};
+
+Scheduler sched;
+
+WorkProcess fast(sched, HIGH_PRIORITY, 10, 1);
+WorkProcess slow(sched, MEDIUM_PRIORITY, 100, 5, 30, 5);
+WorkProcess flaky(sched, LOW_PRIORITY, 250, 2, 0, 0, 3);
+
+// Move whatever is in the trace buffer to the file
+static void dump(FILE *out)
+{
+    TraceRecord records[16];
+    uint16_t count;
+    while ((count = sched.readTrace(records, 16)))
+        fwrite(records, sizeof(TraceRecord), count, out);
+}
+
+int main()
+{
+    FILE *out = fopen("trace.bin", "wb");
+    if (!out) {
+        perror("trace.bin");
+        return 1;
+    }
+
+    fast.add(true);
+    slow.add(true);
+    flaky.add(true);
+
+    uint32_t start = Scheduler::getCurrTS();
+    while (Scheduler::getCurrTS() - start < 2000)
+    {
+        sched.runOrSleep();
+        dump(out);
+    }
+
+    fclose(out);
+    printf("Wrote trace.bin, %u records lost\n", (unsigned)sched.getTraceLost());
+    return 0;
+}
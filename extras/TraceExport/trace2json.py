@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""
+trace2json.py
+Turns a dump of scheduler trace records (see Scheduler::readTrace()) into Chrome trace JSON,
+open it in chrome://tracing or https://ui.perfetto.dev
+
+The dump is the records back to back as they came out of readTrace(), 8 bytes each, little endian:
+    uint32 ts, uint8 event, uint8 id, uint16 arg
+
+usage: trace2json.py dump.bin [-o trace.json] [--us] [--names 1=sensor,2=logger]
+Timestamps are taken as milliseconds, unless the library was built with _MICROS_PRECISION (--us)
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+# TraceEvent in Includes.h
+TRACE_DISPATCH_START = 1
+TRACE_DISPATCH_END = 2
+TRACE_JOB = 3
+TRACE_WARNING = 4
+TRACE_EXCEPTION = 5
+TRACE_TIMEOUT = 6
+TRACE_AGING_BOOST = 7
+
+# ProcessWarning in Includes.h
+WARNINGS = {0: "overscheduled", 1: "timed out", 2: "over budget", 3: "unschedulable", 4: "no frame"}
+
+# Scheduler::QueableOperation
+PENDING_SERVICE = 7
+HALT = 8
+GROUP_PENDING_SERVICE = 9
+
+LIFECYCLE = {1: "add", 2: "destroy", 3: "destroy+add", 4: "restart"}
+ENABLES = {1: "enable", 2: "disable"}
+
+RECORD = struct.Struct("<IBBH")
+
+# The scheduler gets its own row, each process gets one after it
+SCHEDULER_TID = 0
+
+
+def read_records(data):
+    if len(data) % RECORD.size:
+        print("warning: %d trailing bytes ignored" % (len(data) % RECORD.size), file=sys.stderr)
+    for off in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        yield RECORD.unpack_from(data, off)
+
+
+def unwrap(records):
+    """Timestamps are 32 bits and wrap around, make them keep counting up"""
+    last = None
+    total = 0
+    for ts, event, pid, arg in records:
+        if last is not None:
+            delta = (ts - last) & 0xFFFFFFFF
+            if delta >= 0x80000000:
+                delta -= 0x100000000
+            total += delta
+        last = ts
+        yield total, event, pid, arg
+
+
+def job_name(arg):
+    op = arg & 0xFF
+    if op == HALT:
+        return "halt"
+    if op not in (PENDING_SERVICE, GROUP_PENDING_SERVICE):
+        return "job %d" % op
+
+    ops = arg >> 8
+    parts = []
+    pre = (ops >> 3) & 0x03
+    post = (ops >> 5) & 0x03
+    if pre in ENABLES:
+        parts.append(ENABLES[pre])
+    if ops & 0x07 in LIFECYCLE:
+        parts.append(LIFECYCLE[ops & 0x07])
+    if post in ENABLES:
+        parts.append(ENABLES[post])
+    if ops & 0x80:
+        parts.append("reschedule")
+    name = "+".join(parts) or "nothing"
+    return "group " + name if op == GROUP_PENDING_SERVICE else name
+
+
+def convert(records, scale, names):
+    def name(pid):
+        return names.get(pid, "process %d" % pid)
+
+    events = []
+    seen = set()
+    open_start = None
+
+    def instant(ts, tid, label, args=None):
+        events.append({"name": label, "ph": "i", "s": "t", "ts": ts * scale,
+                       "pid": 0, "tid": tid, "args": args or {}})
+
+    for ts, event, pid, arg in unwrap(records):
+        if pid:
+            seen.add(pid)
+
+        if event == TRACE_DISPATCH_START:
+            open_start = (ts, pid, arg)
+        elif event == TRACE_DISPATCH_END:
+            # The start was lost (overwritten, or before the dump began)
+            if not open_start or open_start[1] != pid:
+                open_start = None
+                continue
+            start, _, forced = open_start
+            open_start = None
+            args = {"forced": bool(forced), "disabled": bool(arg)}
+            # Once on the process' row for its jitter, and once on the scheduler's row to see who had the processor
+            for tid in (pid, SCHEDULER_TID):
+                events.append({"name": name(pid), "ph": "X", "ts": start * scale,
+                               "dur": (ts - start) * scale, "pid": 0, "tid": tid, "args": args})
+        elif event == TRACE_JOB:
+            instant(ts, SCHEDULER_TID, job_name(arg), {"process": name(pid) if pid else None})
+        elif event == TRACE_WARNING:
+            instant(ts, pid, WARNINGS.get(arg, "warning %d" % arg), {"warning": arg})
+        elif event == TRACE_EXCEPTION:
+            # The exception code is an int, only the low 16 bits are kept
+            instant(ts, pid, "exception", {"code": struct.unpack("<h", struct.pack("<H", arg))[0]})
+        elif event == TRACE_TIMEOUT:
+            instant(ts, pid, "timed out")
+        elif event == TRACE_AGING_BOOST:
+            instant(ts, pid, "aging boost", {"level": arg})
+        else:
+            print("warning: unknown event %d" % event, file=sys.stderr)
+
+    meta = [{"name": "process_name", "ph": "M", "pid": 0, "args": {"name": "ProcessScheduler"}},
+            {"name": "thread_name", "ph": "M", "pid": 0, "tid": SCHEDULER_TID, "args": {"name": "scheduler"}}]
+    for pid in sorted(seen):
+        meta.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": pid, "args": {"name": name(pid)}})
+        meta.append({"name": "thread_sort_index", "ph": "M", "pid": 0, "tid": pid, "args": {"sort_index": pid}})
+
+    return {"traceEvents": meta + events, "displayTimeUnit": "ms"}
+
+
+def parse_names(text):
+    names = {}
+    for item in filter(None, (text or "").split(",")):
+        pid, _, label = item.partition("=")
+        names[int(pid)] = label
+    return names
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Convert a scheduler trace dump to Chrome trace JSON")
+    parser.add_argument("dump", help="the dumped records, - for stdin")
+    parser.add_argument("-o", "--output", help="where to write the JSON, stdout by default")
+    parser.add_argument("--us", action="store_true", help="timestamps are microseconds (_MICROS_PRECISION)")
+    parser.add_argument("--names", help="process names by id, ex: 1=sensor,2=logger")
+    args = parser.parse_args()
+
+    if args.dump == "-":
+        data = sys.stdin.buffer.read()
+    else:
+        with open(args.dump, "rb") as f:
+            data = f.read()
+
+    # Chrome trace timestamps are in microseconds
+    trace = convert(read_records(data), 1 if args.us else 1000, parse_names(args.names))
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
@@ -3,5 +3,12 @@
 
 #include "ProcessScheduler/Process.h"
 #include "ProcessScheduler/Scheduler.h"
+#include "ProcessScheduler/Policy.h"
+#include "ProcessScheduler/StackfulProcess.h"
+#include "ProcessScheduler/CoProcess.h"
+#include "ProcessScheduler/Clock.h"
+#include "ProcessScheduler/Mailbox.h"
+#include "ProcessScheduler/ProcessGroup.h"
+#include "ProcessScheduler/StaticScheduler.h"
 
 #endif
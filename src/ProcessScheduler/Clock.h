@@ -0,0 +1,108 @@
+#ifndef PROCESS_CLOCK_H
+#define PROCESS_CLOCK_H
+
+#include "Includes.h"
+#include "Scheduler.h"
+
+#ifdef _PROCESS_CUSTOM_CLOCK
+
+/*
+* Where the scheduler gets its time from, instead of millis()/micros()
+* Ex: Scheduler::setClock(&myClock);
+*/
+class ProcessClock
+{
+public:
+    /*
+    * Get the current timestamp, in the same units as the periods
+    * NOTE: With _PROCESS_TIMEOUT_INTERRUPTS this is also called from an interrupt
+    *
+    * @return: uint32_t
+    */
+    virtual uint32_t now() = 0;
+
+    /*
+    * Called right after process was serviced, before its run time is measured
+    */
+    virtual void serviced(Process &) {}
+
+    /*
+    * Called by runOrSleep() when nothing is due for time (NEXT_RUN_NEVER if nothing is scheduled),
+    * it may return early. If the time did not move on, runOrSleep() returns and checks again next call
+    * By default it returns right away
+    */
+    virtual void idle(uint32_t) {}
+};
+
+
+/*
+* A clock that only moves when told to, for simulating the scheduler faster than real time
+*   VirtualClock clock;
+*   Scheduler::setClock(&clock);
+*   clock.simulate(sched, 24UL * 60 * 60 * 1000); // A day worth of millis
+*/
+class VirtualClock : public ProcessClock
+{
+public:
+    /*
+    * @param start: The first timestamp, ex: close to 0xFFFFFFFF to test wrapping around
+    * NOTE: run() does nothing while the time is 0, so 0 is skipped over
+    */
+    VirtualClock(uint32_t start = 1) : _now(start), _model(NULL) {}
+
+    virtual uint32_t now() { return _now; }
+    inline void advance(uint32_t time) { _now = _now + time; }
+    inline void set(uint32_t ts) { _now = ts; }
+
+    /*
+    * Charge each service() the time model returns, the clock moves on by that much
+    * NOTE: Without a model, service() takes no time at all (unless it calls advance())
+    */
+    inline void setRunTimeModel(uint32_t (*model)(Process &process)) { _model = model; }
+
+    virtual void serviced(Process &process) { if (_model) advance(_model(process)); }
+    // With nothing scheduled (NEXT_RUN_NEVER) it stays put, jumping that far would wrap every timestamp
+    virtual void idle(uint32_t time) { if (time != NEXT_RUN_NEVER) advance(time); }
+
+    /*
+    * Run sched until duration has gone by on this clock, as fast as it can
+    * Whenever nothing is due, it jumps straight to the next deadline
+    * SchedulerType can be Scheduler or any PolicyScheduler
+    * NOTE: Charge SERVICE_CONSTANTLY processes some run time, or the clock never moves on
+    *
+    * @return: uint32_t number of processes serviced
+    */
+    template <class SchedulerType>
+    uint32_t simulate(SchedulerType &sched, uint32_t duration)
+    {
+        uint32_t start = _now;
+        uint32_t serviced = 0;
+
+        while (_now - start < duration)
+        {
+            int count = sched.run();
+            if (count) {
+                serviced += count;
+                continue;
+            }
+
+            uint32_t left = duration - (_now - start);
+            uint32_t next = sched.timeUntilNextRun();
+            // Due, but run() skipped a timestamp of 0
+            if (!next)
+                next = 1;
+
+            advance(next < left ? next : left);
+        }
+
+        return serviced;
+    }
+
+private:
+    volatile uint32_t _now;
+    uint32_t (*_model)(Process &process);
+};
+
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+#include "CoProcess.h"
+
+#ifdef _PROCESS_COROUTINES
+
+// The frame pool, free frames are linked through their first bytes
+struct alignas(__BIGGEST_ALIGNMENT__) CoroutineFrame
+{
+    union
+    {
+        CoroutineFrame *next;
+        uint8_t bytes[COROUTINE_FRAME_SIZE];
+    };
+};
+
+static CoroutineFrame framePool[COROUTINE_FRAME_COUNT];
+static CoroutineFrame *freeFrames = NULL;
+static uint8_t framesInUse = 0;
+static uint16_t largestFrame = 0;
+
+
+    /*********** ProcessEvent *************/
+    ProcessEvent::ProcessEvent()
+    : _set(false), _waiters(NULL)
+    {
+    }
+
+    void ProcessEvent::set()
+    {
+        CoProcess *woken;
+        ATOMIC_START
+        {
+            _set = true;
+            woken = _waiters;
+            _waiters = NULL;
+            for (CoProcess *curr = woken; curr != NULL; curr = curr->_nextWaiter)
+                curr->_waitingOn = NULL;
+        }
+        ATOMIC_END
+
+        while (woken)
+        {
+            CoProcess *next = woken->_nextWaiter;
+            woken->_nextWaiter = NULL;
+            woken->force();
+            woken = next;
+        }
+    }
+
+    void ProcessEvent::clear()
+    {
+        _set = false;
+    }
+
+    bool ProcessEvent::addWaiter(CoProcess &process)
+    {
+        bool added = false;
+        ATOMIC_START
+        {
+            if (!_set) {
+                process._nextWaiter = _waiters;
+                process._waitingOn = this;
+                _waiters = &process;
+                added = true;
+            }
+        }
+        ATOMIC_END
+        return added;
+    }
+
+    void ProcessEvent::removeWaiter(CoProcess &process)
+    {
+        ATOMIC_START
+        {
+            CoProcess *volatile *link = &_waiters;
+            while (*link && *link != &process)
+                link = &(*link)->_nextWaiter;
+
+            if (*link)
+                *link = process._nextWaiter;
+
+            process._nextWaiter = NULL;
+            process._waitingOn = NULL;
+        }
+        ATOMIC_END
+    }
+
+
+    /*********** CoProcess::Task *************/
+    CoProcess::Task::promise_type::promise_type()
+    : process(static_cast<CoProcess *>(Scheduler::getActive()))
+    {
+    }
+
+    CoProcess::Task CoProcess::Task::promise_type::get_return_object()
+    {
+        return Task(Handle::from_promise(*this));
+    }
+
+    CoProcess::Task CoProcess::Task::promise_type::get_return_object_on_allocation_failure()
+    {
+        return Task();
+    }
+
+    void *CoProcess::Task::promise_type::operator new(size_t size) noexcept
+    {
+        if (size > largestFrame)
+            largestFrame = size;
+
+        // First use, link up the pool
+        if (!freeFrames && !framesInUse) {
+            for (uint8_t i = 0; i < COROUTINE_FRAME_COUNT; i++) {
+                framePool[i].next = freeFrames;
+                freeFrames = &framePool[i];
+            }
+        }
+
+        if (size > COROUTINE_FRAME_SIZE || !freeFrames)
+            return NULL;
+
+        CoroutineFrame *frame = freeFrames;
+        freeFrames = frame->next;
+        framesInUse++;
+        return frame;
+    }
+
+    void CoProcess::Task::promise_type::operator delete(void *frame) noexcept
+    {
+        CoroutineFrame *f = static_cast<CoroutineFrame *>(frame);
+        f->next = freeFrames;
+        freeFrames = f;
+        framesInUse--;
+    }
+
+
+    /*********** CoProcess *************/
+    CoProcess::CoProcess(Scheduler &manager, ProcPriority priority, uint32_t period,
+            int iterations, uint16_t overSchedThresh)
+    : Process(manager, priority, period, iterations, overSchedThresh),
+    _frame(nullptr), _waitingOn(NULL), _nextWaiter(NULL)
+    {
+    }
+
+    CoProcess::~CoProcess()
+    {
+        dropSuspended();
+    }
+
+    uint16_t CoProcess::getLargestFrame()
+    {
+        return largestFrame;
+    }
+
+    uint8_t CoProcess::getFramesInUse()
+    {
+        return framesInUse;
+    }
+
+    /*********** PROTECTED *************/
+    void CoProcess::service()
+    {
+        // force()d, but what it is waiting for did not happen yet
+        if (_resume == RESUME_ON_WAKE && _waitingOn)
+            return;
+
+        // Only set again if it suspends, so a stale frame is never resumed after an exception
+        bool resume = _resume != RESUME_NONE;
+        _resume = RESUME_NONE;
+
+        if (!resume) {
+            // Left behind by an exception
+            if (_frame) {
+                _frame.destroy();
+                _frame = nullptr;
+            }
+
+            _frame = task().release();
+            if (!_frame) {
+                raiseWarning(WARNING_PROC_NO_FRAME);
+                return;
+            }
+        }
+
+        _frame.resume();
+
+        // Done with this iteration
+        if (_frame.done()) {
+            _frame.destroy();
+            _frame = nullptr;
+        }
+    }
+
+    /*********** PRIVATE *************/
+    void CoProcess::suspend(uint8_t how, uint32_t ts)
+    {
+        _resumeTS = ts;
+        _resume = how;
+    }
+
+    bool CoProcess::wait(ProcessEvent &event)
+    {
+        if (!event.addWaiter(*this))
+            return false; // It was set in the meantime
+
+        suspend(RESUME_ON_WAKE, 0);
+        return true;
+    }
+
+    void CoProcess::dropSuspended()
+    {
+        // An interrupt could set() the event it is waiting for
+        ATOMIC_START
+        {
+            if (_waitingOn)
+                _waitingOn->removeWaiter(*this);
+        }
+        ATOMIC_END
+
+        if (_frame) {
+            _frame.destroy();
+            _frame = nullptr;
+        }
+
+        Process::dropSuspended();
+    }
+
+#endif
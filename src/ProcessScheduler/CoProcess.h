@@ -0,0 +1,168 @@
+#ifndef CO_PROCESS_H
+#define CO_PROCESS_H
+
+#include "Includes.h"
+#include "Process.h"
+
+#ifdef _PROCESS_COROUTINES
+
+#include <coroutine>
+
+class CoProcess;
+
+/*
+* Something CoProcesses can wait for, co_await event
+* Once set() it stays set until clear(), so waiting on a set event does not suspend
+* NOTE: set() and clear() can be called from an interrupt
+*/
+class ProcessEvent
+{
+    friend class CoProcess;
+public:
+    ProcessEvent();
+
+    // Set the event, and wake up every CoProcess waiting for it
+    void set();
+    void clear();
+    inline bool isSet() { return _set; }
+
+private:
+    // Add a waiting process, false if it is already set
+    bool addWaiter(CoProcess &process);
+    void removeWaiter(CoProcess &process);
+
+    volatile bool _set;
+    CoProcess *volatile _waiters;
+};
+
+
+/*
+* A Process whose task() is a C++20 coroutine, override task() instead of service()
+* Inside task() it can give up the processor, and pick up right where it left off:
+*   co_await scheduler.sleep(50); // Resume after at least 50
+*   co_await scheduler.sleep(0); // Resume once the other ready processes had their turn
+*   co_await event; // Resume once a ProcessEvent is set
+* One iteration is one whole run of task(), the period is from the start of one to the next
+* Its frame comes from a fixed pool (see COROUTINE_FRAME_SIZE in Config.h), not the heap
+*/
+class CoProcess : public Process
+{
+    friend class ProcessEvent;
+public:
+    // The type task() returns
+    class Task
+    {
+    public:
+        struct promise_type
+        {
+            promise_type();
+
+            Task get_return_object();
+            static Task get_return_object_on_allocation_failure();
+            std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+            std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+            void return_void() {}
+            void unhandled_exception() {}
+
+            struct SleepAwaiter
+            {
+                CoProcess *process;
+                uint32_t time;
+                bool await_ready() { return false; }
+                void await_suspend(std::coroutine_handle<>) { process->suspend(RESUME_AT_TS, Scheduler::getCurrTS() + time); }
+                void await_resume() {}
+            };
+
+            struct EventAwaiter
+            {
+                CoProcess *process;
+                ProcessEvent &event;
+                bool await_ready() { return event.isSet(); }
+                bool await_suspend(std::coroutine_handle<>) { return process->wait(event); }
+                void await_resume() {}
+            };
+
+            SleepAwaiter await_transform(ProcessSleep sleep) { return SleepAwaiter{process, sleep.time}; }
+            EventAwaiter await_transform(ProcessEvent &event) { return EventAwaiter{process, event}; }
+
+            // Frames come from the pool
+            static void *operator new(size_t size) noexcept;
+            static void operator delete(void *frame) noexcept;
+
+            CoProcess *process;
+        };
+
+        typedef std::coroutine_handle<promise_type> Handle;
+
+        Task() : _handle(nullptr) {}
+        explicit Task(Handle handle) : _handle(handle) {}
+        Task(Task &&other) : _handle(other._handle) { other._handle = nullptr; }
+        Task(const Task &) = delete;
+        Task &operator=(const Task &) = delete;
+        ~Task() { if (_handle) _handle.destroy(); }
+
+        // Take the frame, the Task no longer destroys it
+        inline Handle release() { Handle h = _handle; _handle = nullptr; return h; }
+
+    private:
+        Handle _handle;
+    };
+
+    /*
+    * @param manager: The scheduler overseeing this Process
+    * (see Process for the rest)
+    */
+    CoProcess(Scheduler &manager, ProcPriority priority, uint32_t period,
+            int iterations=RUNTIME_FOREVER,
+            uint16_t overSchedThresh = OVERSCHEDULED_NO_WARNING);
+    ~CoProcess();
+
+    /*
+    * Determine if task() is in the middle of an iteration (sleeping or waiting)
+    * NOTE: Destroying or restarting the Process drops that iteration
+    *
+    * @return: bool
+    */
+    inline bool isSuspended() { return _resume != RESUME_NONE; }
+
+    /*
+    * Get the biggest frame any task() has asked for, to help size COROUTINE_FRAME_SIZE
+    *
+    * @return: uint16_t bytes
+    */
+    static uint16_t getLargestFrame();
+
+    /*
+    * Get the number of frames in use from the pool
+    *
+    * @return: uint8_t count
+    */
+    static uint8_t getFramesInUse();
+
+protected:
+    /*
+    * This is where your Process' routine goes, instead of service()
+    * It has to be a coroutine, so it needs at least one co_await (or co_return)
+    * NOTE: If there is no free frame big enough, it will not start and
+    * WARNING_PROC_NO_FRAME is triggered
+    */
+    virtual Task task() = 0;
+
+    // Resumes task(), do not override
+    virtual void service();
+
+private:
+    // Stop after this slice, and resume how
+    void suspend(uint8_t how, uint32_t ts);
+    // Wait for event, false if it is already set
+    bool wait(ProcessEvent &event);
+    virtual void dropSuspended();
+
+    Task::Handle _frame;
+    ProcessEvent *volatile _waitingOn; // Cleared when the event wakes it up
+    CoProcess *_nextWaiter;
+};
+
+#endif
+
+#endif
@@ -1,7 +1,11 @@
 #ifndef PS_CONFIG_H
 #define PS_CONFIG_H
 
+#ifdef ARDUINO
 #include <Arduino.h>
+#else
+#include <stdint.h>
+#endif
 
 /* Uncomment this to allow Exception Handling functionality */
 //#define _PROCESS_EXCEPTION_HANDLING
@@ -13,13 +17,162 @@
 /* Uncomment this to allow Process timing statistics functionality */
 //#define _PROCESS_STATISTICS
 
+/* Uncomment this to also keep a histogram of each Process' run time, for getRunTimePercentile() */
+// This requires _PROCESS_STATISTICS to also be enabled
+// Costs RUNTIME_HISTOGRAM_BUCKETS * 2 + 4 bytes of RAM per Process
+//#define _PROCESS_RUNTIME_HISTOGRAM
+
+/* Uncomment this to keep a histogram of each Process' start delay (how late it started) */
+// Costs LATENCY_HISTOGRAM_BUCKETS * 2 + 4 bytes of RAM per Process
+//#define _PROCESS_LATENCY_HISTOGRAM
+
+/* Uncomment this to have the scheduler check that enabled processes can all keep up */
+// Give each process a worst case run time with setWorstCaseRunTime()
+// With _PROCESS_STATISTICS it is also measured
+//#define _PROCESS_ADMISSION_CONTROL
+
+/* Uncomment this to let processes at lower priority levels get a turn now and then, see Scheduler::setAging() */
+// A level that had something ready for too long, or was passed over too many times, goes first once
+//#define _PROCESS_AGING
+
+/* Uncomment this to be able to give each priority level a share of the processor time, see Scheduler::setLevelShare() */
+// ex: 70/20/10, the lower levels keep getting their share no matter how busy the higher ones are
+//#define _PROCESS_FAIR_SHARE
+
+/* Uncomment this to allow StackfulProcess, a process with its own stack that can yield() and resume */
+// Supported on AVR and x86-64
+//#define _PROCESS_STACKFUL
+
+/* Uncomment this to allow CoProcess, a process whose task() is a C++20 coroutine */
+// Needs a compiler with coroutine support (ex: -std=c++20)
+//#define _PROCESS_COROUTINES
+
+/* Uncomment this to let processes run a little late, to share a wakeup with others, see Process::setSlack() */
+// Ex: periods of 98, 100 and 105 ms with some slack wake the processor once instead of three times
+//#define _PROCESS_TIMER_SLACK
+
+/* Uncomment this to let the scheduler read time from a ProcessClock instead, see Clock.h */
+// Ex: a VirtualClock, to simulate hours of scheduling in seconds
+//#define _PROCESS_CUSTOM_CLOCK
+
+/* Uncomment this to have the scheduler record what it does in a trace buffer, see Scheduler::readTrace() */
+// Costs SCHEDULER_TRACE_SIZE * 8 bytes of RAM, extras/TraceExport turns a dump into a timeline
+//#define _PROCESS_TRACE
+
 /* Uncomment this to use microseconds instead of milliseconds for timestamp unit (more precise) */
 //#define _MICROS_PRECISION
 
+/* Uncomment this to shrink each Process, for fitting more of them on a small AVR */
+// Flags are packed into bits, and processes find their scheduler instead of keeping a reference to it
+// NOTE: Only one Scheduler can exist, and the overscheduled threshold has to be at most 255
+// Sizes on AVR: 46 bytes by default, 35 compact, 27 also with 16 bit timestamps, and 21 also
+// with _PROCESS_LINEAR_SCAN. The list based scheduler before the heaps took 29, so even the
+// smallest layout is only about 1.4x smaller than that, not 2-3x: the vtable pointer, period,
+// timestamps, iteration count and queued operations are still there (see PROCESS_SIZES in Process.cpp)
+//#define _PROCESS_COMPACT
+
+/* Uncomment this to find the next process by scanning the process table instead of keeping heaps */
+// Saves three pointers per Process, but picking the next process takes a pass over every added one
+//#define _PROCESS_LINEAR_SCAN
+
+/* The width of the timestamps and periods kept in each Process, 32 or 16 */
+// 16 saves 8 bytes per Process, but periods, and how far behind or ahead of its schedule
+// a process gets, have to stay under 32768 (ms, or us with _MICROS_PRECISION)
+#ifndef PROCESS_TIMESTAMP_BITS
+#define PROCESS_TIMESTAMP_BITS 32
+#endif
+
+
+/* The size of the scheduler job queue, must be a power of two (at most 128) */
+//increase if add(), destroy(), enable(), or disable() is returning false*/
+// Each slot costs a sequence number, a pointer and an operation byte of RAM (4 bytes on AVR)
+#ifndef SCHEDULER_JOB_QUEUE_SIZE
+#define SCHEDULER_JOB_QUEUE_SIZE 32
+#endif
+
+#ifdef _PROCESS_COROUTINES
+/* CoProcess coroutine frames come from a fixed pool, one frame per task() in progress */
+// If a task() needs a bigger frame than this (bytes), it will not start, see CoProcess::getLargestFrame()
+#ifndef COROUTINE_FRAME_SIZE
+#define COROUTINE_FRAME_SIZE 128
+#endif
+#ifndef COROUTINE_FRAME_COUNT
+#define COROUTINE_FRAME_COUNT 4
+#endif
+#endif
+
+#ifdef _PROCESS_AGING
+/* How long a level can have something ready without getting a turn, in timestamps (about a second) */
+#ifndef AGING_DEFAULT_WAIT
+#ifdef _MICROS_PRECISION
+#define AGING_DEFAULT_WAIT 1000000
+#else
+#define AGING_DEFAULT_WAIT 1000
+#endif
+#endif
+/* How many times a level can be passed over, AGING_OFF to only go by time */
+#ifndef AGING_DEFAULT_PASSED
+#define AGING_DEFAULT_PASSED AGING_OFF
+#endif
+#endif
+
+#ifdef _PROCESS_FAIR_SHARE
+/* Each round of fair share scheduling, a level gets this much time per share, in timestamps */
+// With shares that add up to 100, a round is 100 times this
+#ifndef FAIR_SHARE_QUANTUM
+#ifdef _MICROS_PRECISION
+#define FAIR_SHARE_QUANTUM 1000
+#else
+#define FAIR_SHARE_QUANTUM 1
+#endif
+#endif
+#endif
+
+#ifdef _PROCESS_TRACE
+/* The number of records the trace buffer holds, must be a power of two, the oldest get overwritten */
+#ifndef SCHEDULER_TRACE_SIZE
+#define SCHEDULER_TRACE_SIZE 32
+#endif
+#endif
 
-/* The size of the scheduler job queue, */
-//increase if add(), destroy(), enable(), disable(), or updateStats() is returning false*/
-#define SCHEDULER_JOB_QUEUE_SIZE 20
+#ifdef _PROCESS_LATENCY_HISTOGRAM
+/* Start delay histogram buckets per Process, 0-3 get one each, then each power of two gets two */
+// The last bucket counts everything past it, 20 buckets go up to 767 before that
+#ifndef LATENCY_HISTOGRAM_BUCKETS
+#define LATENCY_HISTOGRAM_BUCKETS 20
+#endif
+#endif
+
+#ifdef _PROCESS_RUNTIME_HISTOGRAM
+/* Run time histogram buckets per Process, same layout as LATENCY_HISTOGRAM_BUCKETS */
+#ifndef RUNTIME_HISTOGRAM_BUCKETS
+#define RUNTIME_HISTOGRAM_BUCKETS 20
+#endif
+#endif
+
+#if PROCESS_TIMESTAMP_BITS == 16
+    // Timestamps are compared by their difference, which wraps around
+    typedef uint16_t pTime_t;
+    typedef int16_t pTimeDiff_t;
+#else
+    typedef uint32_t pTime_t;
+    typedef int32_t pTimeDiff_t;
+#endif
+
+#ifdef _PROCESS_COMPACT
+    // Type used for the overscheduled threshold and count
+    typedef uint8_t pBehind_t;
+#else
+    typedef uint16_t pBehind_t;
+#endif
+
+/* The max number of processes that can be added to the scheduler at once (at most 255), */
+// each one costs a process pointer and an id byte of RAM, whether it is used or not
+// With the default 32 processes and 32 queue slots that is 96 + 128 = 224 bytes on AVR,
+// lower both if there are only a few processes
+#ifndef SCHEDULER_MAX_PROCESSES
+#define SCHEDULER_MAX_PROCESSES 32
+#endif
 
 typedef enum ProcPriority
 {
@@ -41,10 +194,26 @@ typedef enum ProcPriority
     typedef uint32_t hIterCount_t;
     // Type used to track process total runtime
     typedef uint32_t hTimeCount_t;
+    // Type used to track the scheduler's total busy, idle, and overhead time (never divided)
+    typedef uint64_t sTimeCount_t;
 /**************************************/
 
     // What to divide the two vars above when overflow is about to happen
     #define HISTORY_DIV_FACTOR 2
+
+    // Load is averaged over windows of 2^LOAD_WINDOW_BITS, about a second either way
+    #ifndef LOAD_WINDOW_BITS
+        #ifdef _MICROS_PRECISION
+            #define LOAD_WINDOW_BITS 20
+        #else
+            #define LOAD_WINDOW_BITS 10
+        #endif
+    #endif
+
+    // Each window counts for 1/2^LOAD_EWMA_SHIFT of the load, the rest is what it was
+    #ifndef LOAD_EWMA_SHIFT
+        #define LOAD_EWMA_SHIFT 2
+    #endif
 #endif
 
 #endif
@@ -0,0 +1,131 @@
+#include "Context.h"
+
+#ifdef _PROCESS_STACKFUL
+
+#if defined(__AVR__)
+
+// Callee saved: r2-r17, r28, r29. from is in r25:r24, to is in r23:r22
+asm(
+    ".text\n"
+    ".global processContextSwitch\n"
+    ".type processContextSwitch, @function\n"
+    "processContextSwitch:\n"
+    "    push r2\n"
+    "    push r3\n"
+    "    push r4\n"
+    "    push r5\n"
+    "    push r6\n"
+    "    push r7\n"
+    "    push r8\n"
+    "    push r9\n"
+    "    push r10\n"
+    "    push r11\n"
+    "    push r12\n"
+    "    push r13\n"
+    "    push r14\n"
+    "    push r15\n"
+    "    push r16\n"
+    "    push r17\n"
+    "    push r28\n"
+    "    push r29\n"
+    "    in r18, __SP_L__\n"
+    "    in r19, __SP_H__\n"
+    "    movw r30, r24\n"
+    "    st Z, r18\n"
+    "    std Z+1, r19\n"
+    // SREG is restored after the next instruction, so no interrupt sees half a stack pointer
+    "    in __tmp_reg__, __SREG__\n"
+    "    cli\n"
+    "    out __SP_H__, r23\n"
+    "    out __SREG__, __tmp_reg__\n"
+    "    out __SP_L__, r22\n"
+    "    pop r29\n"
+    "    pop r28\n"
+    "    pop r17\n"
+    "    pop r16\n"
+    "    pop r15\n"
+    "    pop r14\n"
+    "    pop r13\n"
+    "    pop r12\n"
+    "    pop r11\n"
+    "    pop r10\n"
+    "    pop r9\n"
+    "    pop r8\n"
+    "    pop r7\n"
+    "    pop r6\n"
+    "    pop r5\n"
+    "    pop r4\n"
+    "    pop r3\n"
+    "    pop r2\n"
+    "    ret\n"
+    ".size processContextSwitch, .-processContextSwitch\n"
+);
+
+void *processContextInit(uint8_t *stack, uint16_t size, void (*entry)())
+{
+    // The stack pointer points at the next free byte
+    uint8_t *sp = stack + size - 1;
+
+    // Return address for ret, high byte on top
+    uint16_t addr = (uint16_t)entry;
+    *sp-- = addr & 0xFF;
+    *sp-- = addr >> 8;
+#if defined(__AVR_3_BYTE_PC__)
+    *sp-- = 0;
+#endif
+
+    // The saved registers
+    for (uint8_t i = 0; i < 18; i++)
+        *sp-- = 0;
+
+    return sp;
+}
+
+#elif defined(__x86_64__)
+
+#if defined(__APPLE__)
+    #define CONTEXT_SWITCH_SYMBOL "_processContextSwitch"
+#else
+    #define CONTEXT_SWITCH_SYMBOL "processContextSwitch"
+#endif
+
+// System V ABI, callee saved: rbp, rbx, r12-r15. from is in rdi, to is in rsi
+asm(
+    ".text\n"
+    ".globl " CONTEXT_SWITCH_SYMBOL "\n"
+    CONTEXT_SWITCH_SYMBOL ":\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+);
+
+void *processContextInit(uint8_t *stack, uint16_t size, void (*entry)())
+{
+    // 16 byte aligned, then entry is called as if it was pushed a return address
+    void **sp = (void **)((uintptr_t)(stack + size) & ~(uintptr_t)15);
+
+    *--sp = NULL; // Return address of entry, it never returns
+    *--sp = (void *)entry;
+
+    // The saved registers
+    for (uint8_t i = 0; i < 6; i++)
+        *--sp = NULL;
+
+    return sp;
+}
+
+#endif
+
+#endif
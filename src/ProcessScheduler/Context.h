@@ -0,0 +1,29 @@
+#ifndef PROCESS_CONTEXT_H
+#define PROCESS_CONTEXT_H
+
+#include "Includes.h"
+
+#ifdef _PROCESS_STACKFUL
+
+#if !defined(__AVR__) && !(defined(__x86_64__) && !defined(_WIN32))
+    #error "_PROCESS_STACKFUL is only supported on AVR and x86-64"
+#endif
+
+/*
+* Push the callee saved registers onto the current stack, and store the stack pointer in *from
+* Then switch to the stack pointer to, and pop the registers that were saved there
+* It returns when something switches back to *from
+*/
+extern "C" void processContextSwitch(void **from, void *to);
+
+/*
+* Lay out a fresh stack so the first processContextSwitch() to it calls entry
+* NOTE: entry must never return
+*
+* @return: The stack pointer to switch to
+*/
+void *processContextInit(uint8_t *stack, uint16_t size, void (*entry)());
+
+#endif
+
+#endif
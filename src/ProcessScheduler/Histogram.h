@@ -0,0 +1,110 @@
+#ifndef PROCESS_HISTOGRAM_H
+#define PROCESS_HISTOGRAM_H
+
+#include "Includes.h"
+
+// Linear buckets per power of two
+#define HISTOGRAM_SUB_BUCKET_BITS 1
+
+/*
+* A log bucketed (HDR style) histogram of times, O(1) to count one
+* 0-3 get a bucket each, then each power of two is split into two, the last bucket counts everything past it
+* Each bucket is 2 bytes, when one is full they are all halved so the shape stays the same
+*/
+template <uint8_t BUCKETS>
+class LogHistogram
+{
+public:
+    LogHistogram() { reset(); }
+
+    void count(uint32_t time)
+    {
+        uint8_t b = bucket(time);
+
+        if (_counts[b] == 0xFFFF) {
+            for (uint8_t i = 0; i < BUCKETS; i++)
+                _counts[i] >>= 1;
+        }
+
+        _counts[b]++;
+        if (time > _max)
+            _max = time;
+    }
+
+    /*
+    * Get the time that percent of the counted times stayed within
+    * It is rounded up to the end of its bucket (at most half again as high), but never past the max
+    *
+    * @return: uint32_t time, 0 if nothing was counted
+    */
+    uint32_t percentile(uint8_t percent)
+    {
+        uint32_t total = 0;
+        for (uint8_t i = 0; i < BUCKETS; i++)
+            total += _counts[i];
+
+        if (!total)
+            return 0;
+
+        // The count that has to be covered, at least one
+        uint32_t target = (total * percent + 99) / 100;
+        if (!target)
+            target = 1;
+
+        uint32_t seen = 0;
+        for (uint8_t i = 0; i < BUCKETS - 1; i++)
+        {
+            seen += _counts[i];
+            if (seen >= target) {
+                uint32_t end = bucketStart(i + 1) - 1;
+                return end < _max ? end : _max;
+            }
+        }
+
+        // The last bucket has no end
+        return _max;
+    }
+
+    inline uint32_t getMax() { return _max; }
+    inline uint16_t getCount(uint8_t b) { return _counts[b]; }
+
+    void reset()
+    {
+        for (uint8_t i = 0; i < BUCKETS; i++)
+            _counts[i] = 0;
+        _max = 0;
+    }
+
+    // The shortest time that is counted in bucket b
+    static uint32_t bucketStart(uint8_t b)
+    {
+        if (b < (2 << HISTOGRAM_SUB_BUCKET_BITS))
+            return b;
+
+        uint8_t shift = (b >> HISTOGRAM_SUB_BUCKET_BITS) - 1;
+        uint32_t sub = b & ((1 << HISTOGRAM_SUB_BUCKET_BITS) - 1);
+        return ((1UL << HISTOGRAM_SUB_BUCKET_BITS) + sub) << shift;
+    }
+
+    // The bucket time is counted in
+    static uint8_t bucket(uint32_t time)
+    {
+        // Small ones are exact
+        if (time < (2 << HISTOGRAM_SUB_BUCKET_BITS))
+            return time;
+
+        // Position of the highest bit set, then the next bits pick the linear sub bucket
+        uint8_t msb = sizeof(unsigned long) * 8 - 1 - __builtin_clzl(time);
+        uint8_t shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+        uint32_t b = ((uint32_t)(shift + 1) << HISTOGRAM_SUB_BUCKET_BITS) +
+            ((time >> shift) & ((1 << HISTOGRAM_SUB_BUCKET_BITS) - 1));
+
+        return b < BUCKETS ? b : BUCKETS - 1;
+    }
+
+private:
+    uint16_t _counts[BUCKETS];
+    uint32_t _max;
+};
+
+#endif
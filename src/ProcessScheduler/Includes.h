@@ -1,14 +1,17 @@
 #ifndef SCHEDULER_PROCESS_INCLUDES_H
 #define SCHEDULER_PROCESS_INCLUDES_H
 
-#include <Arduino.h>
-#include <RingBuf.h>
 #include "Config.h"
 
 
 class Scheduler;
 class Process;
+#ifdef _PROCESS_CUSTOM_CLOCK
+class ProcessClock;
+#endif
 
+// The values are fixed, so they mean the same whichever options are enabled
+// (a trace records them, see extras/TraceExport/trace2json.py)
 typedef enum ProcessWarning
 {
     // This Process is scheduled to often
@@ -17,7 +20,22 @@ typedef enum ProcessWarning
 #ifdef _PROCESS_TIMEOUT_INTERRUPTS
     // The scheduler interrupted your process service routine because it was taking longer than timeout set
     // This will likley leave you Process in an unknown state, perhaps call restart()
-    ERROR_PROC_TIMED_OUT
+    ERROR_PROC_TIMED_OUT = 1,
+#endif
+
+#ifdef _PROCESS_STATISTICS
+    // A single service() took longer than the budget set with setRunTimeBudget()
+    WARNING_PROC_OVER_BUDGET = 2,
+#endif
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+    // Enabling this process would put the scheduler over its utilization bound
+    WARNING_PROC_UNSCHEDULABLE = 3,
+#endif
+
+#ifdef _PROCESS_COROUTINES
+    // A CoProcess task() could not start, there was no free frame big enough for it
+    WARNING_PROC_NO_FRAME = 4,
 #endif
 } ProcessWarning;
 
@@ -26,6 +44,8 @@ typedef enum ProcessWarning
 #define SERVICE_SECONDLY 1000
 #define SERVICE_MINUTELY 60000
 #define SERVICE_HOURLY 3600000
+// Only serviced when force()d, ex: by a Mailbox, it waits in no heap until then
+#define SERVICE_ON_EVENT 0xFFFFFFFF
 
 // Number of Processs
 #define RUNTIME_FOREVER -1
@@ -33,6 +53,8 @@ typedef enum ProcessWarning
 
 #define PROCESS_NO_TIMEOUT 0
 
+#define PROCESS_NO_BUDGET 0
+
 #define OVERSCHEDULED_NO_WARNING 0
 
 #define LONGJMP_ISR_CODE -1000
@@ -40,8 +62,130 @@ typedef enum ProcessWarning
 
 #define ALL_PRIORITY_LEVELS -1
 
+// Turns off either aging bound, see Scheduler::setAging()
+#define AGING_OFF 0
+
+// Utilization is fixed point, UTILIZATION_ONE is the whole processor
+#define UTILIZATION_SHIFT 10
+#define UTILIZATION_ONE (1 << UTILIZATION_SHIFT)
+// Use the Liu & Layland bound for however many processes are enabled
+#define UTILIZATION_BOUND_LIU_LAYLAND 0
+
+typedef enum AdmissionMode
+{
+    // Enable anything
+    ADMISSION_OFF = 0,
+    // Enable it anyways, but trigger WARNING_PROC_UNSCHEDULABLE
+    ADMISSION_WARN,
+    // Trigger WARNING_PROC_UNSCHEDULABLE, and leave it disabled
+    ADMISSION_REFUSE
+} AdmissionMode;
+
+#define NEXT_RUN_NEVER 0xFFFFFFFF
+
+// Timestamps and heap keys are compared with wrap around, so they have to stay closer than this
+#define PROCESS_TIME_MAX ((uint32_t)((pTime_t)-1 >> 1))
+
+// A runFor() budget that never runs out
+#define RUN_BUDGET_UNLIMITED 0xFFFFFFFF
+
+#ifdef _PROCESS_TRACE
+// What a trace record is about, the numbers are part of the dump format (see extras/TraceExport)
+typedef enum TraceEvent
+{
+    // id: the process, arg: 1 if it was a forced iteration
+    TRACE_DISPATCH_START = 1,
+    // id: the process, arg: 1 if it is disabled now (ran out of iterations)
+    TRACE_DISPATCH_END = 2,
+    // id: the process (0 for the scheduler), arg: the operation, the pending operations in the high byte
+    TRACE_JOB = 3,
+    // id: the process, arg: the ProcessWarning
+    TRACE_WARNING = 4,
+    // id: the process, arg: the exception code
+    TRACE_EXCEPTION = 5,
+    // id: the process that was interrupted
+    TRACE_TIMEOUT = 6,
+    // id: the process that went ahead of higher priority levels, arg: its level
+    TRACE_AGING_BOOST = 7
+} TraceEvent;
+
+// One trace record, 8 bytes (little endian on every supported board)
+struct TraceRecord
+{
+    uint32_t ts;
+    uint8_t event;
+    uint8_t id;
+    uint16_t arg;
+};
+#endif
+
+// Process types that can stop in the middle of an iteration, and resume it later
+#if defined(_PROCESS_STACKFUL) || defined(_PROCESS_COROUTINES)
+    #define _PROCESS_RESUMABLE
+#endif
+
+#if defined(_PROCESS_COROUTINES) && !defined(__cpp_impl_coroutine)
+    #error "_PROCESS_COROUTINES needs a compiler with C++20 coroutines (ex: -std=c++20)"
+#endif
+
+#ifdef _PROCESS_COROUTINES
+// What Scheduler::sleep() returns, for a CoProcess to co_await
+struct ProcessSleep
+{
+    uint32_t time;
+};
+#endif
+
+// How a suspended process resumes
+#define RESUME_NONE 0 // Not suspended
+#define RESUME_AT_TS 1 // Once _resumeTS is due
+#define RESUME_ON_WAKE 2 // Once force()d
+
+// Heap ids, ready heaps are numbered 0 to NUM_PRIORITY_LEVELS-1
+#define HEAP_SLEEP NUM_PRIORITY_LEVELS
+#define HEAP_NONE 0x0F // Fits in the bits _PROCESS_COMPACT keeps it in
+static_assert(HEAP_SLEEP < HEAP_NONE, "Too many priority levels, heap ids have to fit in 4 bits");
+
+#if PROCESS_TIMESTAMP_BITS != 16 && PROCESS_TIMESTAMP_BITS != 32
+    #error "'PROCESS_TIMESTAMP_BITS' must be 16 or 32"
+#endif
+
 #ifndef SCHEDULER_JOB_QUEUE_SIZE
-    #define SCHEDULER_JOB_QUEUE_SIZE 20
+    #define SCHEDULER_JOB_QUEUE_SIZE 32
+#endif
+
+#if (SCHEDULER_JOB_QUEUE_SIZE & (SCHEDULER_JOB_QUEUE_SIZE - 1)) || SCHEDULER_JOB_QUEUE_SIZE > 128
+    #error "'SCHEDULER_JOB_QUEUE_SIZE' must be a power of two, and at most 128"
+#endif
+
+#ifndef SCHEDULER_MAX_PROCESSES
+    #define SCHEDULER_MAX_PROCESSES 32
+#endif
+
+#if SCHEDULER_MAX_PROCESSES > 255
+    #error "'SCHEDULER_MAX_PROCESSES' can be at most 255, ids are 8 bits"
+#endif
+
+#ifdef _PROCESS_TRACE
+    #if (SCHEDULER_TRACE_SIZE & (SCHEDULER_TRACE_SIZE - 1)) || SCHEDULER_TRACE_SIZE > 4096
+        #error "'SCHEDULER_TRACE_SIZE' must be a power of two, and at most 4096"
+    #endif
+#endif
+
+#if defined(_PROCESS_RUNTIME_HISTOGRAM) && !defined(_PROCESS_STATISTICS)
+    #error "'_PROCESS_RUNTIME_HISTOGRAM' requires enabling `_PROCESS_STATISTICS`"
+#endif
+
+#ifdef _PROCESS_RUNTIME_HISTOGRAM
+    #if RUNTIME_HISTOGRAM_BUCKETS < 4 || RUNTIME_HISTOGRAM_BUCKETS > 64
+        #error "'RUNTIME_HISTOGRAM_BUCKETS' must be between 4 and 64"
+    #endif
+#endif
+
+#ifdef _PROCESS_LATENCY_HISTOGRAM
+    #if LATENCY_HISTOGRAM_BUCKETS < 4 || LATENCY_HISTOGRAM_BUCKETS > 64
+        #error "'LATENCY_HISTOGRAM_BUCKETS' must be between 4 and 64"
+    #endif
 #endif
 
 #if defined(ARDUINO_ARCH_AVR)
@@ -50,13 +194,24 @@ typedef enum ProcessWarning
     #define ATOMIC_START ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
     #define ATOMIC_END }
 
+    // Byte reads and writes are atomic
+    typedef uint8_t queue_index_t;
+    #define MEMORY_BARRIER() __asm__ __volatile__("" ::: "memory")
+
     #include <avr/sleep.h>
     #define HALT_PROCESSOR() \
             do { noInterrupts(); sleep_enable(); sleep_cpu(); } while(0)
 
+    // Call with interrupts disabled, sleep can only be entered before an interrupt is serviced
+    // Timer0 (millis) wakes us at least every 1.024 ms, so the timeout is not needed
+    #define IDLE_PROCESSOR(timeout) \
+            do { set_sleep_mode(SLEEP_MODE_IDLE); sleep_enable(); interrupts(); sleep_cpu(); sleep_disable(); } while(0)
+
     #define ENABLE_SCHEDULER_ISR() \
             do { OCR0A = 0xAA; TIMSK0 |= _BV(OCIE0A); } while(0)
 
+    #define SCHEDULER_ISR() ISR(TIMER0_COMPA_vect)
+
 
     #define DISABLE_SCHEDULER_ISR() \
             do { TIMSK0 &= ~_BV(OCIE0A); } while(0)
@@ -78,15 +233,75 @@ typedef enum ProcessWarning
     #define ATOMIC_START do { uint32_t _savedIS = xt_rsil(15) ;
     #define ATOMIC_END xt_wsr_ps(_savedIS) ;} while(0);
 
+    typedef uint32_t queue_index_t;
+    #define MEMORY_BARRIER() __asm__ __volatile__("" ::: "memory")
+
     #define HALT_PROCESSOR() \
             ESP.deepSleep(0)
 
+    // The SDK light sleeps inside delay() when WiFi is set to LIGHT_SLEEP_T
+    #define IDLE_PROCESSOR(timeout) \
+            do { interrupts(); delay(1); } while(0)
+
     // Not supported on ESP8266
     #define ENABLE_SCHEDULER_ISR()
     #define DISABLE_SCHEDULER_ISR()
 
+
+#elif !defined(ARDUINO) && (defined(__unix__) || defined(__APPLE__))
+    // Running natively, see Posix.h
+    #define SCHEDULER_POSIX
+    #include <setjmp.h>
+    #include "Posix.h"
+
+    #define ATOMIC_START do { sigset_t _savedIS; posixBlockSignals(&_savedIS);
+    #define ATOMIC_END posixRestoreSignals(&_savedIS); } while(0);
+
+    typedef uint32_t queue_index_t;
+    #define MEMORY_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+    // Nothing to halt, run() just returns
+    #define HALT_PROCESSOR()
+
+    #define IDLE_PROCESSOR(timeout) \
+            posixIdle(timeout)
+
+    #define ENABLE_SCHEDULER_ISR() \
+            posixEnableTimer()
+
+    #define DISABLE_SCHEDULER_ISR() \
+            posixDisableTimer()
+
+    #define SCHEDULER_ISR() void schedulerTimerISR(int)
+
 #else
-    #error "This library only supports AVR and ESP8266 Boards."
+    #error "This library only supports AVR and ESP8266 Boards, and POSIX systems."
+#endif
+
+
+// Compare and swap, used by the lock free job queue
+#ifdef SCHEDULER_POSIX
+template <typename T>
+inline bool atomicCompareSwap(volatile T *ptr, T expected, T desired)
+{
+    return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+#else
+// Both supported boards are single core, so a few cycles with interrupts off is all it takes
+template <typename T>
+inline bool atomicCompareSwap(volatile T *ptr, T expected, T desired)
+{
+    bool swapped = false;
+    ATOMIC_START
+    {
+        if (*ptr == expected) {
+            *ptr = desired;
+            swapped = true;
+        }
+    }
+    ATOMIC_END
+    return swapped;
+}
 #endif
 
 
@@ -100,6 +315,10 @@ typedef enum ProcessWarning
     #error "'_PROCESS_EXCEPTION_HANDLING' is not supported on the ESP8266."
 #endif
 
+#if defined(_PROCESS_TIMEOUT_INTERRUPTS) && defined(SCHEDULER_POSIX) && defined(__APPLE__)
+    #error "'_PROCESS_TIMEOUT_INTERRUPTS' needs timer_create(), which macOS does not have."
+#endif
+
 
 #if defined(_PROCESS_TIMEOUT_INTERRUPTS) && !defined(_PROCESS_EXCEPTION_HANDLING)
     #error "'_PROCESS_TIMEOUT_INTERRUPTS' requires enabling `_PROCESS_EXCEPTION_HANDLING`"
@@ -0,0 +1,130 @@
+#ifndef SCHEDULER_JOB_QUEUE_H
+#define SCHEDULER_JOB_QUEUE_H
+
+#include "Includes.h"
+
+/*
+* Fixed size, lock free, multi producer / single consumer queue
+* Any number of producers (including interrupts) can add() at once without blocking each other,
+* only the scheduler pulls items out
+* Every cell has a sequence number telling whose turn it is:
+*   seq == pos     -> free, a producer may claim position pos
+*   seq == pos + 1 -> holds the item added at position pos
+* SIZE must be a power of two, so positions can wrap around
+*/
+template <typename T, uint8_t SIZE>
+class JobQueue
+{
+public:
+    JobQueue()
+    {
+        for (uint8_t i = 0; i < SIZE; i++)
+            _cells[i].seq = i;
+        _head = 0;
+        _tail = 0;
+    }
+
+    /*
+    * Add an item, safe to call from anywhere
+    *
+    * @return: True on success, false if the queue is full
+    */
+    bool add(const T &item)
+    {
+        queue_index_t pos;
+        if (!claim(pos))
+            return false;
+
+        publish(pos, item);
+        return true;
+    }
+
+    /*
+    * First half of add(), reserve a position for an item
+    * NOTE: A claimed position MUST be published, the consumer will not get past it until then
+    *
+    * @return: True on success, false if the queue is full
+    */
+    bool claim(queue_index_t &pos)
+    {
+        pos = _head;
+
+        for (;;)
+        {
+            queue_index_t seq = _cells[pos % SIZE].seq;
+            MEMORY_BARRIER();
+            queue_index_t diff = (queue_index_t)(seq - pos);
+
+            if (diff == 0) {
+                // Cell is free, try to claim the position
+                if (atomicCompareSwap(&_head, pos, (queue_index_t)(pos + 1)))
+                    return true;
+            } else if (isNegative(diff)) {
+                return false; // Still holds the item from one lap ago, full
+            }
+            pos = _head; // Another producer claimed it first, try again
+        }
+    }
+
+    /*
+    * Second half of add(), store the item at a claimed position
+    */
+    void publish(queue_index_t pos, const T &item)
+    {
+        Cell *cell = &_cells[pos % SIZE];
+        cell->data = item;
+        MEMORY_BARRIER();
+        cell->seq = pos + 1;
+    }
+
+    /*
+    * Pull the oldest item, ONLY THE CONSUMER MAY CALL THIS
+    *
+    * @return: True on success, false if the queue is empty
+    */
+    bool pull(T &item)
+    {
+        Cell *cell = &_cells[_tail % SIZE];
+        if (cell->seq != (queue_index_t)(_tail + 1))
+            return false;
+
+        MEMORY_BARRIER();
+        item = cell->data;
+        MEMORY_BARRIER();
+        cell->seq = _tail + SIZE; // Free for the next lap
+        _tail = _tail + 1;
+        return true;
+    }
+
+    /*
+    * ONLY THE CONSUMER MAY CALL THIS
+    * NOTE: An item still being added counts as not there yet
+    */
+    bool isEmpty() { return _cells[_tail % SIZE].seq != (queue_index_t)(_tail + 1); }
+
+    /*
+    * Number of claimed positions not pulled yet, safe to call from anywhere
+    * NOTE: Only a snapshot, producers and the consumer might be changing it
+    */
+    uint8_t count()
+    {
+        queue_index_t tail = _tail;
+        queue_index_t used = (queue_index_t)(_head - tail);
+        return used > SIZE ? SIZE : used;
+    }
+
+private:
+    static inline bool isNegative(queue_index_t diff) { return diff > ((queue_index_t)~(queue_index_t)0 >> 1); }
+
+    struct Cell
+    {
+        volatile queue_index_t seq;
+        T data;
+    };
+
+    Cell _cells[SIZE];
+    volatile queue_index_t _head; // Next position to claim, shared by the producers
+    volatile queue_index_t _tail; // Next position to pull, only changed by the consumer
+};
+
+#endif
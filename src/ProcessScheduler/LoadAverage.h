@@ -0,0 +1,98 @@
+#ifndef PROCESS_LOAD_AVERAGE_H
+#define PROCESS_LOAD_AVERAGE_H
+
+#include "Includes.h"
+
+#ifdef _PROCESS_STATISTICS
+
+// Load is fixed point, LOAD_ONE is the whole processor
+#define LOAD_SHIFT 15
+#define LOAD_ONE ((uint16_t)1 << LOAD_SHIFT)
+
+// Window numbers wrap around along with the timestamps
+#define LOAD_WINDOW_MASK (0xFFFFFFFF >> LOAD_WINDOW_BITS)
+
+/*
+* How much of the processor something used lately, as an exponentially weighted moving average
+* Time is cut into windows of 2^LOAD_WINDOW_BITS, once one is over the busy time in it is
+* folded in with a weight of 1/2^LOAD_EWMA_SHIFT. O(1) to count, no division or floating point
+* NOTE: Busy time is counted in the window it ended in, at most a whole window
+*/
+class LoadAverage
+{
+public:
+    LoadAverage() { reset(0); }
+
+    /*
+    * Count busy time that ended at now
+    */
+    void count(uint32_t now, uint32_t busy)
+    {
+        uint32_t window = now >> LOAD_WINDOW_BITS;
+        if (window != _window) {
+            _avg = get(now);
+            _window = window;
+            _busy = 0;
+        }
+
+        _busy += busy;
+    }
+
+    /*
+    * Get the average as of the last window that ended before now
+    *
+    * @return: uint16_t load, LOAD_ONE is the whole processor
+    */
+    uint16_t get(uint32_t now)
+    {
+        uint32_t passed = ((now >> LOAD_WINDOW_BITS) - _window) & LOAD_WINDOW_MASK;
+        if (!passed)
+            return _avg;
+
+        uint16_t avg = _avg - (_avg >> LOAD_EWMA_SHIFT) + (sample() >> LOAD_EWMA_SHIFT);
+
+        // Nothing was counted in the windows after it, this ends after a few dozen at most
+        while (--passed && avg) {
+            uint16_t decay = avg >> LOAD_EWMA_SHIFT;
+            avg -= decay ? decay : avg;
+        }
+
+        return avg;
+    }
+
+    /*
+    * @return: uint8_t percent of the processor
+    */
+    inline uint8_t getPercent(uint32_t now) { return ((uint32_t)get(now) * 100 + LOAD_ONE / 2) >> LOAD_SHIFT; }
+
+    /*
+    * Start over from nothing at now
+    */
+    void reset(uint32_t now)
+    {
+        _avg = 0;
+        _window = now >> LOAD_WINDOW_BITS;
+        _busy = 0;
+    }
+
+private:
+    // The busy time counted in _window, as a load
+    uint16_t sample()
+    {
+        if (_busy >= ((uint32_t)1 << LOAD_WINDOW_BITS))
+            return LOAD_ONE;
+#if LOAD_WINDOW_BITS > LOAD_SHIFT
+        return _busy >> (LOAD_WINDOW_BITS - LOAD_SHIFT);
+#else
+        return _busy << (LOAD_SHIFT - LOAD_WINDOW_BITS);
+#endif
+    }
+
+    uint16_t _avg;
+    uint32_t _window;
+    uint32_t _busy;
+};
+
+#endif
+
+#endif
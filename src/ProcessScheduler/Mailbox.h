@@ -0,0 +1,82 @@
+#ifndef PROCESS_MAILBOX_H
+#define PROCESS_MAILBOX_H
+
+#include "Includes.h"
+#include "JobQueue.h"
+#include "Process.h"
+
+/*
+* A fixed size mailbox that hands messages (pointers to T) over to one receiving Process
+* Any number of senders can send() at once, including interrupts, nothing is copied but the pointer
+* The sender must leave a message alone until the receiver is done with it
+* Sending wakes the receiver up with force(), so give it a period of SERVICE_ON_EVENT
+* and it is only serviced when there is mail:
+*   Mailbox<Reading, 8> readings(consumer);
+*   readings.send(&reading); // From anywhere
+*   while (Reading *r = readings.receive()) {...} // In consumer's service()
+* SIZE must be a power of two, at most 128
+*/
+template <typename T, uint8_t SIZE>
+class Mailbox
+{
+public:
+    /*
+    * @param receiver: The process to wake up on every send(), NULL to only poll
+    */
+    Mailbox(Process *receiver = NULL) : _receiver(receiver) {}
+    Mailbox(Process &receiver) : _receiver(&receiver) {}
+
+    /*
+    * Hand message over to the receiver, and wake it up
+    * NOTE: Safe to call from an interrupt
+    *
+    * @return: True on success, false if the mailbox is full
+    */
+    bool send(T *message)
+    {
+        if (!_queue.add(message))
+            return false;
+
+        if (_receiver)
+            _receiver->force();
+        return true;
+    }
+
+    inline bool send(T &message) { return send(&message); }
+
+    /*
+    * Take the oldest message, ONLY THE RECEIVER MAY CALL THIS
+    * Take all of them each service(), the receiver is woken up again for anything sent after
+    *
+    * @return: A pointer to the message, NULL if there are none
+    */
+    T *receive()
+    {
+        T *message;
+        return _queue.pull(message) ? message : NULL;
+    }
+
+    /*
+    * ONLY THE RECEIVER MAY CALL THIS
+    */
+    inline bool isEmpty() { return _queue.isEmpty(); }
+
+    /*
+    * Number of messages not received yet
+    * NOTE: Only a snapshot, senders might be adding more
+    *
+    * @return: uint8_t count
+    */
+    inline uint8_t count() { return _queue.count(); }
+
+    inline void setReceiver(Process *receiver) { _receiver = receiver; }
+    inline Process *getReceiver() { return _receiver; }
+
+private:
+    static_assert(SIZE && !(SIZE & (SIZE - 1)) && SIZE <= 128, "Mailbox SIZE must be a power of two, and at most 128");
+
+    JobQueue<T *, SIZE> _queue;
+    Process *volatile _receiver;
+};
+
+#endif
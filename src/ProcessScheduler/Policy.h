@@ -0,0 +1,235 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include "Includes.h"
+#include "Scheduler.h"
+#include "Process.h"
+
+/*
+* Scheduling policies
+*
+* Once a process is due it gets moved into a ready heap, the policy decides which
+* ready heap (level) and where in it (key). Lower levels run first, then lower keys.
+* Forced processes always run first.
+*
+* A policy is a struct with two static methods:
+*   static uint8_t readyLevel(Process &process); // 0 to NUM_PRIORITY_LEVELS-1
+*   static uint32_t readyKey(Process &process); // Compared with wrap around
+* And the utilization bound used for admission control:
+*   static const uint16_t UTILIZATION_BOUND;
+*/
+
+
+// The default, strict priority levels, then whichever process is the most behind
+struct FixedPriorityPolicy
+{
+    static const uint16_t UTILIZATION_BOUND = UTILIZATION_BOUND_LIU_LAYLAND;
+
+    static inline uint8_t readyLevel(Process &process)
+    {
+        return process.getPriority();
+    }
+
+    static inline uint32_t readyKey(Process &process)
+    {
+        return process.getScheduledTS() + process.getPeriod();
+    }
+};
+
+
+// Earliest deadline first, a process's deadline is its next release
+// Priorities are ignored, SERVICE_CONSTANTLY processes have no deadline so they
+// only run in the background (round robin) when nothing else is ready
+struct EdfPolicy
+{
+    static const uint16_t UTILIZATION_BOUND = UTILIZATION_ONE;
+
+    static inline uint8_t readyLevel(Process &process)
+    {
+        return process.getPeriod() == SERVICE_CONSTANTLY ? NUM_PRIORITY_LEVELS - 1 : 0;
+    }
+
+    static inline uint32_t readyKey(Process &process)
+    {
+        return process.getScheduledTS() + 2 * process.getPeriod();
+    }
+};
+
+
+// Rate monotonic, the shorter the period the higher the priority
+// Priorities are ignored, SERVICE_CONSTANTLY processes only run in the background
+struct RateMonotonicPolicy
+{
+    static const uint16_t UTILIZATION_BOUND = UTILIZATION_BOUND_LIU_LAYLAND;
+
+    static inline uint8_t readyLevel(Process &process)
+    {
+        return process.getPeriod() == SERVICE_CONSTANTLY ? NUM_PRIORITY_LEVELS - 1 : 0;
+    }
+
+    static inline uint32_t readyKey(Process &process)
+    {
+        // Keys are compared with wrap around, so stay below PROCESS_TIME_MAX
+        if (process.getPeriod() == SERVICE_CONSTANTLY)
+            return process.getScheduledTS();
+        return process.getPeriod() < PROCESS_TIME_MAX ? process.getPeriod() : PROCESS_TIME_MAX;
+    }
+};
+
+
+/*
+* A scheduler that uses a different policy, use it just like Scheduler
+* Ex: PolicyScheduler<EdfPolicy> sched;
+*/
+template <class Policy>
+class PolicyScheduler : public Scheduler
+{
+public:
+#ifdef _PROCESS_ADMISSION_CONTROL
+    PolicyScheduler() { setUtilizationBound(Policy::UTILIZATION_BOUND); }
+#endif
+
+    int run() { return runPolicy<Policy>(); }
+    int runFor(uint32_t budget) { return runPolicy<Policy>(budget); }
+    int runUntilIdle() { return runFor(RUN_BUDGET_UNLIMITED); }
+
+    int runOrSleep()
+    {
+        int count = run();
+
+        // Nothing was due, sleep until something is
+        if (!count && !getActive())
+            idleUntilNextRun();
+
+        return count;
+    }
+};
+
+
+/************ Scheduler templates ***************/
+template <class Policy>
+int Scheduler::runPolicy(uint32_t budget)
+{
+    // Already running in another call frame
+    if (_active) return 0;
+
+    int count = 0;
+#ifdef _PROCESS_STATISTICS
+    uint32_t enter = getCurrTS();
+    sTimeCount_t busy = _busyTime;
+#endif
+    processQueue();
+
+    uint32_t start = getCurrTS();
+    if (start)
+    {
+        releaseDue<Policy>(start);
+
+        // Only what was released above, anything due later goes in the sleep heap until the next pass
+        uint32_t now = start;
+        for (Process *torun = popReady(now); torun; torun = popReady(now))
+        {
+            dispatch(*torun);
+            count++;
+
+            // Only if something was queued, ex: a process disabled by the one that just ran
+            if (!_queue.isEmpty())
+                processQueue();
+
+            // run(), or runUntilIdle(), no need to look at the clock
+            if (!budget)
+                break;
+            if (budget == RUN_BUDGET_UNLIMITED) {
+#ifdef _PROCESS_AGING
+                // How long the levels waited, for their boosts
+                now = getCurrTS();
+#endif
+                continue;
+            }
+
+            now = getCurrTS();
+            if (now - start >= budget)
+                break;
+        }
+    }
+#ifdef _PROCESS_STATISTICS
+    countOverhead(enter, _busyTime - busy);
+#endif
+    delay(0); // For esp8266
+
+    return count;
+}
+
+
+template <class Policy>
+void Scheduler::releaseDue(uint32_t now)
+{
+#ifdef _PROCESS_TIMER_SLACK
+    bool woke = false;
+#endif
+
+    // The top of the sleep heap is always the next one due
+    for (Process *top = _sleepHeap; top != NULL; top = _sleepHeap)
+    {
+        if (!top->_heapForced && (pTimeDiff_t)(top->_heapKey - (pTime_t)now) > 0)
+            break;
+
+        heapPop(HEAP_SLEEP);
+        heapPush(*top, Policy::readyLevel(*top), Policy::readyKey(*top));
+#ifdef _PROCESS_TIMER_SLACK
+        woke = true;
+#endif
+    }
+
+#ifdef _PROCESS_TIMER_SLACK
+    if (woke) {
+        _wakeups++;
+        releaseSlack<Policy>(now);
+    }
+#endif
+}
+
+#ifdef _PROCESS_TIMER_SLACK
+template <class Policy>
+void Scheduler::releaseSlack(uint32_t now)
+{
+#ifdef _PROCESS_LINEAR_SCAN
+    for (uint8_t i = 0; i < SCHEDULER_MAX_PROCESSES; i++)
+    {
+        Process *p = _procTable[i];
+        if (p && p->_heapId == HEAP_SLEEP && (pTimeDiff_t)((pTime_t)dueTS(*p) - (pTime_t)now) <= 0) {
+            heapRemove(*p);
+            heapPush(*p, Policy::readyLevel(*p), Policy::readyKey(*p));
+            _wakeupsSaved++;
+        }
+    }
+#else
+    // The sleep heap is keyed by the end of each window, so whatever has started
+    // its window is at most _maxSlack past now. Pop those, and put back the ones too early
+    Process *early = NULL;
+    for (Process *top = _sleepHeap; top != NULL; top = _sleepHeap)
+    {
+        if ((pTimeDiff_t)(top->_heapKey - (pTime_t)(now + _maxSlack)) > 0)
+            break;
+
+        heapPop(HEAP_SLEEP);
+        if ((pTimeDiff_t)((pTime_t)dueTS(*top) - (pTime_t)now) <= 0) {
+            heapPush(*top, Policy::readyLevel(*top), Policy::readyKey(*top));
+            _wakeupsSaved++;
+        } else {
+            top->_heapNext = early;
+            early = top;
+        }
+    }
+
+    while (early)
+    {
+        Process *next = early->_heapNext;
+        heapPush(*early, HEAP_SLEEP, early->_heapKey);
+        early = next;
+    }
+#endif
+}
+#endif
+
+#endif
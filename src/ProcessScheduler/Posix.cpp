@@ -0,0 +1,148 @@
+#include "Includes.h"
+
+#ifdef SCHEDULER_POSIX
+
+#include <errno.h>
+#include <sys/select.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static sigset_t interruptsOnMask; // What noInterrupts() replaced
+static bool interruptsOff = false;
+
+static uint64_t monotonicMicros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleepFor(struct timespec ts)
+{
+    // A signal cuts it short, keep going for what is left
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR);
+}
+
+
+uint32_t millis()
+{
+    return monotonicMicros() / 1000;
+}
+
+uint32_t micros()
+{
+    return monotonicMicros();
+}
+
+void delay(uint32_t ms)
+{
+    if (!ms)
+        return;
+
+    struct timespec ts = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000 };
+    sleepFor(ts);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+    sleepFor(ts);
+}
+
+void noInterrupts()
+{
+    if (interruptsOff)
+        return;
+
+    posixBlockSignals(&interruptsOnMask);
+    interruptsOff = true;
+}
+
+void interrupts()
+{
+    if (!interruptsOff)
+        return;
+
+    interruptsOff = false;
+    posixRestoreSignals(&interruptsOnMask);
+}
+
+void posixBlockSignals(sigset_t *saved)
+{
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, saved);
+}
+
+void posixRestoreSignals(const sigset_t *saved)
+{
+    pthread_sigmask(SIG_SETMASK, saved, NULL);
+}
+
+void posixIdle(uint32_t timeout)
+{
+#ifdef _MICROS_PRECISION
+    uint32_t us = timeout < POSIX_IDLE_MAX_US ? timeout : POSIX_IDLE_MAX_US;
+#else
+    uint32_t us = timeout < POSIX_IDLE_MAX_US / 1000 ? timeout * 1000 : POSIX_IDLE_MAX_US;
+#endif
+
+    // pselect() unblocks the signals only while it sleeps, so one that is
+    // already pending wakes it right away instead of being missed
+    struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+    pselect(0, NULL, NULL, NULL, &ts, interruptsOff ? &interruptsOnMask : NULL);
+    interrupts();
+}
+
+
+#ifdef _PROCESS_TIMEOUT_INTERRUPTS
+static timer_t timer;
+static bool timerCreated = false;
+
+void posixEnableTimer()
+{
+    if (!timerCreated) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = schedulerTimerISR;
+        sigemptyset(&sa.sa_mask);
+        // Not blocked while the handler runs, so longjmp()ing out of it leaves the mask as it was
+        sa.sa_flags = SA_NODEFER | SA_RESTART;
+        sigaction(SIGALRM, &sa, NULL);
+
+        struct sigevent sev;
+        memset(&sev, 0, sizeof(sev));
+        sev.sigev_signo = SIGALRM;
+    #if defined(SIGEV_THREAD_ID) && !defined(sigev_notify_thread_id) && defined(__linux__)
+        // Older glibc does not name it
+        #define sigev_notify_thread_id _sigev_un._tid
+    #endif
+    #if defined(SIGEV_THREAD_ID) && defined(sigev_notify_thread_id)
+        // Interrupt the thread running the scheduler, not whichever thread the kernel picks
+        sev.sigev_notify = SIGEV_THREAD_ID;
+        sev.sigev_notify_thread_id = syscall(SYS_gettid);
+    #else
+        sev.sigev_notify = SIGEV_SIGNAL;
+    #endif
+        timerCreated = timer_create(CLOCK_MONOTONIC, &sev, &timer) == 0;
+        if (!timerCreated)
+            return;
+    }
+
+    // Every 1 ms, like Timer0 on AVR
+    struct itimerspec its = { { 0, 1000000 }, { 0, 1000000 } };
+    timer_settime(timer, 0, &its, NULL);
+}
+
+void posixDisableTimer()
+{
+    if (!timerCreated)
+        return;
+
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+    timer_settime(timer, 0, &its, NULL);
+}
+#endif
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef PROCESS_POSIX_H
+#define PROCESS_POSIX_H
+
+/*
+* Stand ins for the parts of the Arduino core the library uses, so it can run as a
+* normal Linux (or other POSIX) program
+* Signal handlers take the place of interrupts, blocking signals is disabling interrupts
+* NOTE: Only the thread calling run() may touch the scheduler, other threads should send it a signal
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <signal.h>
+
+// CLOCK_MONOTONIC, from an arbitrary starting point, and wraps around like on a board
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// Block or unblock every signal, these do not nest (same as on a board)
+void noInterrupts();
+void interrupts();
+
+// Used by the platform macros in Includes.h
+void posixBlockSignals(sigset_t *saved);
+void posixRestoreSignals(const sigset_t *saved);
+
+// The longest posixIdle() sleeps, so jobs queued from another thread (no signal) get picked up
+#ifndef POSIX_IDLE_MAX_US
+#define POSIX_IDLE_MAX_US 1000
+#endif
+
+// Call with signals blocked, sleeps until a signal, the timeout (ms, or us with
+// _MICROS_PRECISION) or POSIX_IDLE_MAX_US passes, then unblocks them
+void posixIdle(uint32_t timeout);
+
+// Arm or disarm a 1 ms periodic SIGALRM that calls schedulerTimerISR()
+void posixEnableTimer();
+void posixDisableTimer();
+void schedulerTimerISR(int sig);
+
+#endif
@@ -1,70 +1,161 @@
 #include "Process.h"
 #include "Scheduler.h"
 
+// sizeof(Process) pinned for each layout, without the per process options below. In order:
+// default, _PROCESS_LINEAR_SCAN, 16 bit timestamps, both, then the same four with _PROCESS_COMPACT
+// The original scheduler (a list instead of heaps) was 29 bytes on AVR
+#ifdef _PROCESS_COMPACT
+    #define PROCESS_LAYOUT_COMPACT 4
+#else
+    #define PROCESS_LAYOUT_COMPACT 0
+#endif
+#ifdef _PROCESS_LINEAR_SCAN
+    #define PROCESS_LAYOUT_LINEAR 1
+#else
+    #define PROCESS_LAYOUT_LINEAR 0
+#endif
+#if defined(__AVR__)
+static constexpr size_t PROCESS_SIZES[] = {46, 40, 38, 32, 35, 29, 27, 21};
+#elif defined(__x86_64__)
+static constexpr size_t PROCESS_SIZES[] = {96, 72, 88, 64, 64, 40, 56, 32};
+#endif
+
+// The per process options add their fields at the end
+static constexpr size_t PROCESS_OPTIONS_SIZE = 0
+#ifdef _PROCESS_TIMEOUT_INTERRUPTS
+    + sizeof(uint32_t)
+#endif
+#ifdef _PROCESS_TIMER_SLACK
+    + sizeof(uint16_t)
+#endif
+#ifdef _PROCESS_RESUMABLE
+    + sizeof(uint8_t) + sizeof(uint32_t)
+#endif
+#ifdef _PROCESS_LATENCY_HISTOGRAM
+    + sizeof(LogHistogram<LATENCY_HISTOGRAM_BUCKETS>)
+#endif
+#ifdef _PROCESS_ADMISSION_CONTROL
+    + sizeof(uint32_t) + sizeof(uint16_t)
+#endif
+#ifdef _PROCESS_STATISTICS
+    + sizeof(hIterCount_t) + sizeof(hTimeCount_t) + sizeof(LoadAverage) + 3 * sizeof(uint32_t)
+  #ifdef _PROCESS_RUNTIME_HISTOGRAM
+    + sizeof(LogHistogram<RUNTIME_HISTOGRAM_BUCKETS>)
+  #endif
+#endif
+    ;
+
+#if defined(__AVR__) || defined(__x86_64__)
+static constexpr size_t PROCESS_PINNED_SIZE =
+    PROCESS_SIZES[PROCESS_LAYOUT_COMPACT + (PROCESS_TIMESTAMP_BITS == 16) * 2 + PROCESS_LAYOUT_LINEAR];
+#endif
+
+#if defined(__AVR__)
+// No padding, the options add up exactly
+static_assert(sizeof(Process) == PROCESS_PINNED_SIZE + PROCESS_OPTIONS_SIZE, "Process layout changed, update PROCESS_SIZES in Process.cpp");
+#elif defined(__x86_64__)
+// Padded, so only the layouts without options are pinned
+static_assert(PROCESS_OPTIONS_SIZE || sizeof(Process) == PROCESS_PINNED_SIZE, "Process layout changed, update PROCESS_SIZES in Process.cpp");
+#endif
+
     /*********** PUBLIC *************/
     Process::Process(Scheduler &scheduler, ProcPriority priority, uint32_t period,
             int iterations, uint16_t overSchedThresh)
-    : _scheduler(scheduler), _pLevel(priority)
+    :
+#ifndef _PROCESS_COMPACT
+    _scheduler(scheduler),
+#endif
+    _pLevel(priority)
     {
         this->_enabled = false;
+        this->_queuedOps = 0;
         this->_period = period;
         this->_iterations = iterations;
         this->_force = false;
+        this->_sid = 0;
+#ifdef _PROCESS_COMPACT
+        (void)scheduler; // There is only one, see scheduler()
+        this->_overSchedThresh = overSchedThresh < 0xFF ? overSchedThresh : 0xFF;
+#else
+        this->_next = NULL;
+        this->_prev = NULL;
         this->_overSchedThresh = overSchedThresh;
-        resetTimeStamps();
+#endif
+#ifndef _PROCESS_LINEAR_SCAN
+        this->_heapChild = this->_heapNext = this->_heapPrev = NULL;
+#endif
+        this->_heapKey = 0;
+        this->_heapSeq = 0;
+        this->_heapId = HEAP_NONE;
+        this->_heapForced = false;
+        initTimeStamps();
 
 #ifdef _PROCESS_TIMEOUT_INTERRUPTS
         setTimeout(PROCESS_NO_TIMEOUT);
 #endif
+
+#ifdef _PROCESS_TIMER_SLACK
+        this->_slack = 0;
+#endif
+
+#ifdef _PROCESS_RESUMABLE
+        this->_resume = RESUME_NONE;
+        this->_resumeTS = 0;
+#endif
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+        this->_wcet = 0;
+        this->_util = 0;
+#endif
+
+#ifdef _PROCESS_STATISTICS
+        this->_budget = PROCESS_NO_BUDGET;
+        resetRunTimeStats();
+#endif
     }
 
     void Process::resetTimeStamps()
     {
-        ATOMIC_START
-        {
-        this->_scheduledTS = _scheduler.getCurrTS();
-        this->_actualTS = _scheduler.getCurrTS();
-        this->_pBehind = 0;
-        }
-        ATOMIC_END
+        initTimeStamps();
+        scheduler().reschedule(*this);
+    }
+
+    void Process::force()
+    {
+        _force = true;
+        // With the job queue full, the scheduler looks for it on its next pass instead
+        if (!scheduler().reschedule(*this))
+            scheduler()._forceLost = true;
     }
 
     bool Process::disable()
     {
-        return _scheduler.disable(*this);
+        return scheduler().disable(*this);
     }
 
 
     bool Process::enable()
     {
-        return _scheduler.enable(*this);
+        return scheduler().enable(*this);
     }
 
 
     bool Process::destroy()
     {
-        return _scheduler.destroy(*this);
+        return scheduler().destroy(*this);
     }
 
     bool Process::add(bool enableIfNot)
     {
-        return _scheduler.add(*this, enableIfNot);
+        return scheduler().add(*this, enableIfNot);
     }
 
     bool Process::restart()
     {
-        return _scheduler.restart(*this);
+        return scheduler().restart(*this);
     }
 
 
-    bool Process::needsServicing(uint32_t start)
-    {
-        return (isEnabled() &&
-            (_force ||
-            ((getPeriod() == SERVICE_CONSTANTLY || timeToNextRun(start) <= 0) &&
-            (getIterations() == RUNTIME_FOREVER || getIterations() > 0))));
-    }
-
     void Process::setIterations(int iterations)
     {
         ATOMIC_START
@@ -72,6 +163,7 @@
             _iterations = iterations;
         }
         ATOMIC_END
+        scheduler().reschedule(*this);
     }
 
 
@@ -82,25 +174,10 @@
             _period = period;
         }
         ATOMIC_END
+        scheduler().reschedule(*this);
     }
 
 
-    // both must need servicing
-    Process *Process::runWhich(Process *p1, Process *p2)
-    {
-        // All things being equal pick yes
-
-        // Compare forces
-        if (p1->forceSet() || p2->forceSet())
-            return p1->forceSet() ? p1 : p2;
-
-        // whichever one is more behind goes first
-        return (p1->timeToNextRun() <= p2->timeToNextRun()) ? p1 : p2;
-
-    }
-
-
-
     /*********** PROTECTED *************/
 
     // Fired on creation/destroy
@@ -123,16 +200,51 @@
     /*********** PRIVATE *************/
     bool Process::isPBehind(uint32_t curr)
     {
-        return (curr - getScheduledTS()) >= getPeriod();
+        return (pTime_t)(curr - _scheduledTS) >= _period;
+    }
+
+
+    void Process::raiseWarning(ProcessWarning warning)
+    {
+    #ifdef _PROCESS_TRACE
+        scheduler().trace(TRACE_WARNING, getID(), warning);
+    #endif
+        handleWarning(warning);
+    }
+
+
+    void Process::initTimeStamps()
+    {
+        ATOMIC_START
+        {
+        this->_scheduledTS = Scheduler::getCurrTS();
+        this->_actualTS = Scheduler::getCurrTS();
+        this->_pBehind = 0;
+        }
+        ATOMIC_END
     }
 
 
     void Process::willService(uint32_t now)
     {
+#ifdef _PROCESS_RESUMABLE
+        // Still the same iteration, a force() only woke it up early
+        if (_resume) {
+            _force = false;
+            setActualTS(now);
+            return;
+        }
+#endif
+
+#ifdef _PROCESS_LATENCY_HISTOGRAM
+        // Forced and SERVICE_CONSTANTLY iterations have no start time to be late for
+        bool periodic = !_force && getPeriod() != SERVICE_CONSTANTLY;
+#endif
+
         if (!_force)
         {
             if (getPeriod() != SERVICE_CONSTANTLY)
-                setScheduledTS(getScheduledTS() + getPeriod());
+                setScheduledTS(_scheduledTS + _period);
             else
                 setScheduledTS(now);
         } else {
@@ -141,11 +253,16 @@
 
         setActualTS(now);
 
+#ifdef _PROCESS_LATENCY_HISTOGRAM
+        if (periodic)
+            _startDelays.count(getStartDelay());
+#endif
+
         // Handle scheduler warning
         if (getOverSchedThresh() != OVERSCHEDULED_NO_WARNING && isPBehind(now)) {
             incrPBehind();
             if (getCurrPBehind() >= getOverSchedThresh())
-                handleWarning(WARNING_PROC_OVERSCHEDULED);
+                raiseWarning(WARNING_PROC_OVERSCHEDULED);
         } else {
             resetOverSchedWarning();
         }
@@ -155,6 +272,11 @@
     // Return true if last if should disable
     bool Process::wasServiced(bool wasForced)
     {
+#ifdef _PROCESS_RESUMABLE
+        if (_resume)
+            return false; // Not done with this iteration yet
+#endif
+
         if (!wasForced && getIterations() > 0) { //Was an iteration
             decIterations();
 
@@ -165,8 +287,18 @@
     }
 
 
-#ifdef _PROCESS_TIMEOUT_INTERRUPTS
+#ifdef _PROCESS_TIMER_SLACK
+    void Process::setSlack(uint16_t slack)
+    {
+        _slack = slack;
+        // The scheduler only looks that far ahead for processes to take along
+        if (slack > scheduler()._maxSlack)
+            scheduler()._maxSlack = slack;
+    }
+#endif
+
 
+#ifdef _PROCESS_TIMEOUT_INTERRUPTS
     void Process::setTimeout(uint32_t timeout)
     {
         // Can not let interrupt happen
@@ -180,6 +312,55 @@
 
 #endif
 
+#ifdef _PROCESS_RESUMABLE
+
+    void Process::dropSuspended()
+    {
+        _resume = RESUME_NONE;
+    }
+
+#endif
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+
+    void Process::setWorstCaseRunTime(uint32_t wcet)
+    {
+        ATOMIC_START
+        {
+            _wcet = wcet;
+        }
+        ATOMIC_END
+        scheduler().reschedule(*this);
+    }
+
+    uint16_t Process::getUtilization()
+    {
+        uint32_t wcet, period;
+        ATOMIC_START
+        {
+            wcet = _wcet;
+            period = _period;
+        }
+        ATOMIC_END
+
+        if (period == SERVICE_CONSTANTLY)
+            return 0;
+
+        // It can never keep up, no need to be exact
+        if (wcet >= period)
+            return UTILIZATION_ONE;
+
+        // Keep wcet << UTILIZATION_SHIFT from overflowing
+        while (wcet >> (32 - UTILIZATION_SHIFT)) {
+            wcet >>= 1;
+            period >>= 1;
+        }
+
+        return (wcet << UTILIZATION_SHIFT) / period;
+    }
+
+#endif
+
 #ifdef _PROCESS_STATISTICS
 
     uint32_t Process::getAvgRunTime()
@@ -202,4 +383,27 @@
         ++_histRunTime /= div;
     }
 
+    void Process::resetRunTimeStats()
+    {
+        _minRunTime = NEXT_RUN_NEVER;
+        _maxRunTime = 0;
+    #ifdef _PROCESS_RUNTIME_HISTOGRAM
+        _runTimes.reset();
+    #endif
+    }
+
+    void Process::countRunTime(uint32_t runTime)
+    {
+        if (runTime < _minRunTime)
+            _minRunTime = runTime;
+        if (runTime > _maxRunTime)
+            _maxRunTime = runTime;
+    #ifdef _PROCESS_RUNTIME_HISTOGRAM
+        _runTimes.count(runTime);
+    #endif
+
+        if (_budget != PROCESS_NO_BUDGET && runTime > _budget)
+            raiseWarning(WARNING_PROC_OVER_BUDGET);
+    }
+
 #endif
@@ -3,12 +3,15 @@
 
 #include "Includes.h"
 #include "Scheduler.h"
+#include "Histogram.h"
 
 class Scheduler;
 
 class Process
 {
     friend class Scheduler;
+    friend class StackfulProcess;
+    friend class CoProcess;
 public:
     /*
     * @param manager: The scheduler overseeing this Process
@@ -32,21 +35,13 @@ public:
     bool restart();
 
 
-    /*
-    * Give both processes that need to run p1 and p2
-    * return the process that should run first
-    *
-    * @return: p1 or p2
-    */
-    static Process *runWhich(Process *p1, Process *p2);
-
     ///////////////////// GETTERS /////////////////////////
 
     // These methods are also the same as calling calling scheduler.method(process)
     // See the documentation in Scheduler.h
     inline uint8_t getID() { return _sid; };
     inline bool isEnabled() { return _enabled; }
-    inline bool isNotDestroyed() { return _scheduler.isNotDestroyed(*this); }
+    inline bool isNotDestroyed() { return scheduler().isNotDestroyed(*this); }
 
 
     /*
@@ -54,7 +49,11 @@ public:
     *
     * @return: Refrence to Scheduler
     */
+#ifdef _PROCESS_COMPACT
+    inline Scheduler &scheduler() { return *Scheduler::_instance; }
+#else
     inline Scheduler &scheduler() { return _scheduler; }
+#endif
 
     /*
     * Get the remaining iterations this Process will be serviced
@@ -68,14 +67,18 @@ public:
     *
     * @return: period or SERVICE_CONSTANTLY
     */
+#if PROCESS_TIMESTAMP_BITS == 16
+    inline uint32_t getPeriod() { return _period == (pTime_t)SERVICE_ON_EVENT ? SERVICE_ON_EVENT : _period; }
+#else
     inline uint32_t getPeriod() { return _period; }
+#endif
 
     /*
     * Get the priority for this process
     *
     * @return: ProcPriority level defined in Config.h
     */
-    inline ProcPriority getPriority() { return _pLevel; }
+    inline ProcPriority getPriority() { return static_cast<ProcPriority>(_pLevel); }
 
 
     /*
@@ -84,9 +87,9 @@ public:
     *
     * @return: int32_t time offset
     */
-    inline int32_t timeToNextRun() { return timeToNextRun(_scheduler.getCurrTS()); }
+    inline int32_t timeToNextRun() { return timeToNextRun(Scheduler::getCurrTS()); }
 
-    inline int32_t timeToNextRun(uint32_t curr) { return (int32_t)((_scheduledTS + _period) - curr); }
+    inline int32_t timeToNextRun(uint32_t curr) { return (pTimeDiff_t)((pTime_t)(_scheduledTS + _period) - (pTime_t)curr); }
 
 
     /*
@@ -94,7 +97,7 @@ public:
     *
     * @return: uint32_t timestamp
     */
-    inline uint32_t getActualRunTS() { return _actualTS; }
+    inline uint32_t getActualRunTS() { return expandTS(_actualTS); }
 
 
     /*
@@ -102,7 +105,7 @@ public:
     *
     * @return: uint32_t timestamp
     */
-    inline uint32_t getScheduledTS() { return _scheduledTS; }
+    inline uint32_t getScheduledTS() { return expandTS(_scheduledTS); }
 
 
     /*
@@ -133,6 +136,7 @@ public:
     /*
     * Set the period between when this process is serviced
     * NOTE: Setting period to SERVICE_CONSTANTLY, will have the Scheduler service it as often as possible
+    * and SERVICE_ON_EVENT only when it is force()d (ex: by a Mailbox)
     */
     void setPeriod(uint32_t period);
 
@@ -140,7 +144,7 @@ public:
     * Force the scheduler to service this on the next pass (if enabled)
     * NOTE: This service will not count twoards an iteration
     */
-    inline void force() { _force = true; }
+    void force();
 
     /*
     * Reset the number of period behind count back to zero
@@ -165,16 +169,150 @@ public:
     uint32_t getAvgRunTime();
 
     /*
-    * Returns the computed CPU load % for this process
-    * NOTE: You must call updateStats() on the scheduler to update this value
+    * Returns the % of the processor time this process used lately
+    * It is an average over windows of 2^LOAD_WINDOW_BITS, where the last one counts for 1/2^LOAD_EWMA_SHIFT
+    * NOTE: It changes once a window is over, so it is up to one window behind
     *
     * @return: uint8_t percent
     */
-    inline uint8_t getLoadPercent() { return _histLoadPercent; }
+    inline uint8_t getLoadPercent() { return _load.getPercent(Scheduler::getCurrTS()); }
+
+    /*
+    * Get the shortest and longest a single service() has taken
+    * Unlike the average, these are never divided down, see resetRunTimeStats()
+    * NOTE: For a StackfulProcess or CoProcess, this is each slice between suspends
+    *
+    * @return: uint32_t time, 0 if it was not serviced yet
+    */
+    inline uint32_t getMinRunTime() { return _minRunTime == NEXT_RUN_NEVER ? 0 : _minRunTime; }
+    inline uint32_t getMaxRunTime() { return _maxRunTime; }
+
+    /*
+    * Trigger WARNING_PROC_OVER_BUDGET whenever a single service() takes longer than budget
+    * @param budget: same units as the period, PROCESS_NO_BUDGET to turn it off
+    */
+    inline void setRunTimeBudget(uint32_t budget) { _budget = budget; }
+    inline uint32_t getRunTimeBudget() { return _budget; }
+
+    /*
+    * Start the min and max run time over (and the run time histogram)
+    */
+    void resetRunTimeStats();
+
+  #ifdef _PROCESS_RUNTIME_HISTOGRAM
+    /*
+    * Get the run time that percent of the service() calls stayed within
+    * Ex: getRunTimePercentile(95) is the p95 run time
+    * The buckets are logarithmic, so this is rounded up to the end of one (at most half again as high)
+    *
+    * @return: uint32_t time, 0 if it was not serviced yet
+    */
+    inline uint32_t getRunTimePercentile(uint8_t percent) { return _runTimes.percentile(percent); }
+
+    /*
+    * Get how many service() calls took a run time in bucket (0 to RUNTIME_HISTOGRAM_BUCKETS-1)
+    * NOTE: When a bucket is full, every bucket is halved
+    *
+    * @return: uint16_t count
+    */
+    inline uint16_t getRunTimeCount(uint8_t bucket) { return _runTimes.getCount(bucket); }
+
+    /*
+    * Get the shortest run time that is counted in bucket
+    *
+    * @return: uint32_t time
+    */
+    static inline uint32_t getRunTimeBucketStart(uint8_t bucket) { return LogHistogram<RUNTIME_HISTOGRAM_BUCKETS>::bucketStart(bucket); }
+  #endif
+
+#endif
+
+
+// Enable this option in config.h to have the Scheduler check that processes can keep up
+#ifdef _PROCESS_ADMISSION_CONTROL
+    /*
+    * Get the longest this Process' service routine can take
+    * With _PROCESS_STATISTICS this is raised whenever a longer run is measured
+    *
+    * @return: uint32_t time, 0 if unknown
+    */
+    inline uint32_t getWorstCaseRunTime() { return _wcet; }
+
+    /*
+    * Set the longest this Process' service routine can take, same units as the period
+    */
+    void setWorstCaseRunTime(uint32_t wcet);
+
+    /*
+    * Get the fraction of the processor this Process needs, worst case run time / period
+    * NOTE: SERVICE_CONSTANTLY processes only use spare time, so they count as zero
+    *
+    * @return: uint16_t utilization, UTILIZATION_ONE is the whole processor
+    */
+    uint16_t getUtilization();
+#endif
+
+
+// Enable this option in config.h to keep a histogram of start delays
+#ifdef _PROCESS_LATENCY_HISTOGRAM
+    /*
+    * Get the start delay (see getStartDelay()) that percent of the iterations stayed within
+    * Ex: getStartDelayPercentile(99) is the p99 start delay
+    * NOTE: Only periodic iterations count, forced and SERVICE_CONSTANTLY ones have no start time
+    * The buckets are logarithmic, so this is rounded up to the end of one (at most half again as high)
+    *
+    * @return: uint32_t time, 0 if nothing was counted yet
+    */
+    inline uint32_t getStartDelayPercentile(uint8_t percent) { return _startDelays.percentile(percent); }
 
+    /*
+    * Get the longest start delay counted
+    *
+    * @return: uint32_t time
+    */
+    inline uint32_t getMaxStartDelay() { return _startDelays.getMax(); }
+
+    /*
+    * Get how many iterations started with a delay in bucket (0 to LATENCY_HISTOGRAM_BUCKETS-1)
+    * NOTE: When a bucket is full, every bucket is halved
+    *
+    * @return: uint16_t count
+    */
+    inline uint16_t getStartDelayCount(uint8_t bucket) { return _startDelays.getCount(bucket); }
+
+    /*
+    * Get the shortest start delay that is counted in bucket
+    *
+    * @return: uint32_t time
+    */
+    static inline uint32_t getStartDelayBucketStart(uint8_t bucket) { return LogHistogram<LATENCY_HISTOGRAM_BUCKETS>::bucketStart(bucket); }
+
+    /*
+    * Clear the start delay histogram and max
+    */
+    inline void resetStartDelayStats() { _startDelays.reset(); }
 #endif
 
 
+// Enable this option in config.h to let processes that are due around the same time run together
+#ifdef _PROCESS_TIMER_SLACK
+    /*
+    * Get how late this process may run, see setSlack()
+    *
+    * @return: uint16_t time
+    */
+    inline uint16_t getSlack() { return _slack; }
+
+    /*
+    * Let this process run up to slack late, so it can be serviced along with another process
+    * instead of waking the processor on its own. Whenever some process is due, everything whose
+    * slack window has started goes with it, otherwise it runs at the end of its window.
+    * The period is still counted from when it was due, so it does not drift
+    * NOTE: Keep it below the period, it takes effect from the next time it is due
+    */
+    void setSlack(uint16_t slack);
+#endif
+
 // Enable this option in config.h to allow the Scheduler to interrupt processes that are not returning for their service routine
 #ifdef _PROCESS_TIMEOUT_INTERRUPTS
     /*
@@ -200,7 +338,7 @@ protected:
     * NOTE: that nothing below this call will ever be executed
     * NOTE: ONLY CALL THIS FROM WITHIN YOUR SERVICE ROUTINE
     */
-    inline void yield() { _scheduler.raiseException(LONGJMP_YIELD_CODE); }
+    inline void yield() { scheduler().raiseException(LONGJMP_YIELD_CODE); }
 
 #endif
 
@@ -212,14 +350,14 @@ protected:
     *
     * @return: int32_t time remaining, a negative value means it will happen any time now
     */
-    inline int32_t timeToTimeout() { return _timeout - (_scheduler.getCurrTS() - getActualRunTS()); }
+    inline int32_t timeToTimeout() { return _timeout - (Scheduler::getCurrTS() - getActualRunTS()); }
 #endif
 
     /*
     * Get the delay from when the Scheduler scheduled it to run, to when it actualy was serviced
     * ie. Reset the warning
     */
-    inline uint32_t getStartDelay() { return _actualTS - _scheduledTS; }
+    inline uint32_t getStartDelay() { return (pTime_t)(_actualTS - _scheduledTS); }
 
 
     ///////////////////// VIRTUAL FUNCTIONS /////////////////////////
@@ -277,7 +415,7 @@ protected:
     * NOTE: You might find it useful to store more detailed info about the
     * error condition in class attributes
     */
-    virtual void raiseException(int e) { _scheduler.raiseException(e); }
+    virtual void raiseException(int e) { scheduler().raiseException(e); }
 
     /*
     * This is the Exception handler for your Process' Service routine
@@ -295,20 +433,31 @@ protected:
 
 ////////////// YOU CAN IGNORE THE PRIVATE STUFF BELOW THIS LINE //////////////
 private:
-    // Return true if this Process needs servicing
-    bool needsServicing(uint32_t start);
     // Called right before scheduler services
     void willService(uint32_t now);
     // Called right after scheduler services
     bool wasServiced(bool wasForced);
     // Returns true if this Process is over a period behind
     bool isPBehind(uint32_t curr);
+    // Same as resetTimeStamps(), without asking the scheduler to reschedule
+    void initTimeStamps();
+
+#if PROCESS_TIMESTAMP_BITS == 16
+    // The whole timestamp closest to now that ends in ts
+    static inline uint32_t expandTS(pTime_t ts) { uint32_t now = Scheduler::getCurrTS(); return now + (pTimeDiff_t)(ts - (pTime_t)now); }
+#else
+    static inline uint32_t expandTS(pTime_t ts) { return ts; }
+#endif
 
+#ifndef _PROCESS_COMPACT
     inline bool hasNext() { return _next; }
     // GETTERS
     inline Process *getNext() { return _next; }
+    inline Process *getPrev() { return _prev; }
     // SETTERS
     inline void setNext(Process *next) { this->_next = next; }
+    inline void setPrev(Process *prev) { this->_prev = prev; }
+#endif
     inline void setID(uint8_t sid) { this->_sid = sid; }
     inline void decIterations() { _iterations--; }
     inline void setScheduledTS(uint32_t ts) { _scheduledTS = ts; }
@@ -320,37 +469,101 @@ private:
     inline void setDisabled() { _enabled = false; }
     inline void setEnabled() { _enabled = true; }
 
+    // Record the warning in the scheduler trace, then handleWarning() it
+    void raiseWarning(ProcessWarning warning);
+
+    // Biggest first, so there is no padding between them on 32 bit boards
+#ifndef _PROCESS_COMPACT
     Scheduler &_scheduler;
-    bool _enabled, _force;
-    int _iterations;
-    uint32_t _period;
-    uint8_t _sid;
-    uint32_t _scheduledTS, _actualTS;
     // Linked List
-    Process *volatile _next;
+    Process *volatile _next, *volatile _prev;
+#endif
+#ifndef _PROCESS_LINEAR_SCAN
+    // Sleep/ready heaps (intrusive pairing heaps, see Scheduler)
+    Process *_heapChild, *_heapNext, *_heapPrev;
+#endif
+
+    pTime_t _period;
+    pTime_t _scheduledTS, _actualTS;
+    // Sleep heap: when this process is due, ready heap: the key given by the scheduling policy
+    pTime_t _heapKey;
+#ifndef _PROCESS_COMPACT
+    const ProcPriority _pLevel;
+#endif
 
+    int _iterations;
+    // Breaks ties between equal keys (round robin)
+    uint16_t _heapSeq;
     // Tracks overscheduled
-    uint16_t _overSchedThresh, _pBehind;
+    pBehind_t _overSchedThresh, _pBehind;
 
-    const ProcPriority _pLevel;
+    // Operations waiting in the scheduler job queue, see Scheduler::QueableOperation::merge()
+    volatile uint8_t _queuedOps;
+    // Set from interrupts, so it can not share a byte with the flags below
+    volatile bool _force;
+    uint8_t _sid;
+#ifdef _PROCESS_COMPACT
+    bool _enabled : 1;
+    bool _heapForced : 1;
+    // Which heap it is in, HEAP_NONE if none
+    uint8_t _heapId : 4;
+    const uint8_t _pLevel;
+#else
+    bool _enabled;
+    bool _heapForced;
+    uint8_t _heapId;
+#endif
 
 
 #ifdef _PROCESS_TIMEOUT_INTERRUPTS
     uint32_t _timeout;
 #endif
 
+#ifdef _PROCESS_TIMER_SLACK
+    uint16_t _slack;
+#endif
+
+#ifdef _PROCESS_RESUMABLE
+    // Forget the iteration it was in the middle of, called on destroy and restart
+    virtual void dropSuspended();
+
+    // In the middle of an iteration, it picks up where it left off at _resumeTS, or once woken up
+    uint8_t _resume;
+    uint32_t _resumeTS;
+#endif
+
+#ifdef _PROCESS_LATENCY_HISTOGRAM
+    LogHistogram<LATENCY_HISTOGRAM_BUCKETS> _startDelays;
+#endif
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+    inline void raiseWorstCaseRunTime(uint32_t runTime) { if (runTime > _wcet) _wcet = runTime; }
+
+    uint32_t _wcet;
+    // Utilization counted by the scheduler while enabled
+    uint16_t _util;
+#endif
+
 #ifdef _PROCESS_STATISTICS
     bool statsWillOverflow(hIterCount_t iter, hTimeCount_t tm);
     void divStats(uint8_t div);
     inline void setHistIterations(hIterCount_t val) { _histIterations = val; }
     inline void setHistRuntime(hTimeCount_t val) { _histRunTime = val; }
-    inline void setHistLoadPercent(uint8_t percent) { _histLoadPercent = percent; }
     inline hIterCount_t getHistIterations() { return _histIterations; }
     inline hTimeCount_t getHistRunTime() { return _histRunTime; }
 
     hIterCount_t _histIterations;
     hTimeCount_t _histRunTime;
-    uint8_t _histLoadPercent;
+    LoadAverage _load;
+
+    // Min, max, histogram, and the budget warning
+    void countRunTime(uint32_t runTime);
+
+    uint32_t _minRunTime, _maxRunTime;
+    uint32_t _budget;
+  #ifdef _PROCESS_RUNTIME_HISTOGRAM
+    LogHistogram<RUNTIME_HISTOGRAM_BUCKETS> _runTimes;
+  #endif
 
 #endif
 
@@ -0,0 +1,33 @@
+#include "ProcessGroup.h"
+
+    /*********** PUBLIC *************/
+    ProcessGroup::ProcessGroup(Scheduler &scheduler, Process *const *members, uint8_t count)
+    : _scheduler(scheduler), _members(members), _count(count)
+    {
+        this->_queuedOps = 0;
+    }
+
+    bool ProcessGroup::add(bool enableIfNot)
+    {
+        return _scheduler.add(*this, enableIfNot);
+    }
+
+    bool ProcessGroup::disable()
+    {
+        return _scheduler.disable(*this);
+    }
+
+    bool ProcessGroup::enable()
+    {
+        return _scheduler.enable(*this);
+    }
+
+    bool ProcessGroup::destroy()
+    {
+        return _scheduler.destroy(*this);
+    }
+
+    bool ProcessGroup::restart()
+    {
+        return _scheduler.restart(*this);
+    }
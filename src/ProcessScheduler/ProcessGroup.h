@@ -0,0 +1,72 @@
+#ifndef PROCESS_GROUP_H
+#define PROCESS_GROUP_H
+
+#include "Includes.h"
+#include "Scheduler.h"
+
+/*
+* A set of processes that are brought up and down together, ex: every process of a motor stack
+* scheduler.enable(group) takes one slot in the job queue no matter how many processes are in it,
+* and the whole group is switched in the same processQueue(), it is never only partly enabled
+* Like the process operations, these can be called from anywhere, including interrupts
+*   Process *motorProcs[] = {&encoder, &pid, &driver};
+*   ProcessGroup motors(sched, motorProcs);
+*   motors.restart();
+* NOTE: The group only holds on to the array of pointers, it has to last as long as the group
+*/
+class ProcessGroup
+{
+    friend class Scheduler;
+public:
+    /*
+    * @param manager: The scheduler overseeing the processes
+    * @param members: The processes in this group
+    * @param count: The number of processes in members
+    */
+    ProcessGroup(Scheduler &manager, Process *const *members, uint8_t count);
+
+    template <uint8_t N>
+    ProcessGroup(Scheduler &manager, Process *(&members)[N])
+        : ProcessGroup(manager, members, N) {}
+
+    ///////////////////// GROUP OPERATIONS /////////////////////////
+    // These are all the same as calling scheduler.method(group)
+    // Ex: scheduler.enable(group), see Scheduler.h for documentation
+    bool add(bool enableIfNot=false);
+    bool disable();
+    bool enable();
+    bool destroy();
+    bool restart();
+
+    ///////////////////// GETTERS /////////////////////////
+
+    /*
+    * Get the number of processes in this group
+    *
+    * @return: uint8_t count
+    */
+    inline uint8_t getCount() { return _count; }
+
+    /*
+    * Get the process at index i
+    *
+    * @return: a pointer to the process, NULL if i is out of range
+    */
+    inline Process *getMember(uint8_t i) { return i < _count ? _members[i] : NULL; }
+
+    /*
+    * Get the scheduler that is overseeing this group
+    *
+    * @return: Refrence to Scheduler
+    */
+    inline Scheduler &scheduler() { return _scheduler; }
+
+private:
+    Scheduler &_scheduler;
+    Process *const *_members;
+    uint8_t _count;
+    // Operations waiting in the job queue, merged like a process' (see Scheduler::QueableOperation)
+    volatile uint8_t _queuedOps;
+};
+
+#endif
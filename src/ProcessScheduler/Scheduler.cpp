@@ -1,14 +1,25 @@
 #include "Scheduler.h"
 #include "Process.h"
+#include "ProcessGroup.h"
+#include "Policy.h"
+#include "Clock.h"
 
 Process *Scheduler::_active = NULL;
 
+#ifdef _PROCESS_COMPACT
+Scheduler *Scheduler::_instance = NULL;
+#endif
+
+#ifdef _PROCESS_CUSTOM_CLOCK
+ProcessClock *Scheduler::_clock = NULL;
+#endif
+
 #ifdef _PROCESS_EXCEPTION_HANDLING
 jmp_buf Scheduler::_env = {};
 #endif
 
 #ifdef _PROCESS_TIMEOUT_INTERRUPTS
-ISR(TIMER0_COMPA_vect)
+SCHEDULER_ISR()
 {
     if (Scheduler::getActive()) { // routine is running
         uint32_t timeout = Scheduler::getActive()->getTimeout();
@@ -19,24 +30,72 @@ ISR(TIMER0_COMPA_vect)
 #endif
 
 Scheduler::Scheduler()
-: _pLevels{}
+: _pLevels{}, _procTable{}
 {
-    _lastID = 0;
-    // Create queue
-    _queue = RingBuf_new(sizeof(QueableOperation), SCHEDULER_JOB_QUEUE_SIZE);
+#ifdef _PROCESS_COMPACT
+    _instance = this;
+#endif
+    _heapSeq = 0;
+    _sleepHeap = NULL;
+    _queueHighWater = 0;
+    _queueDropped = 0;
+    _forceLost = false;
+#ifdef _PROCESS_TRACE
+    resetTrace();
+#endif
+#ifdef _PROCESS_STATISTICS
+    resetTimeStats();
+#endif
+#ifdef _PROCESS_ADMISSION_CONTROL
+    _utilBound = UTILIZATION_BOUND_LIU_LAYLAND;
+    _admissionMode = ADMISSION_WARN;
+    _utilCount = 0;
+#endif
+#ifdef _PROCESS_AGING
+    _agingWait = AGING_DEFAULT_WAIT;
+    _agingPassed = AGING_DEFAULT_PASSED;
+#endif
+#ifdef _PROCESS_FAIR_SHARE
+    _fairShare = false;
+    _chargeLevel = 0;
+#endif
+#ifdef _PROCESS_TIMER_SLACK
+    _maxSlack = 0;
+    resetWakeupStats();
+#endif
+    // All ids start out free, handed out in order
+    for (uint8_t i = 0; i < SCHEDULER_MAX_PROCESSES; i++)
+        _freeIDs[i] = i + 1;
+    _freeHead = 0;
+    _freeCount = SCHEDULER_MAX_PROCESSES;
 }
 
 Scheduler::~Scheduler()
 {
     processQueue();
-    RingBuf_delete(_queue);
 }
 
 uint32_t Scheduler::getCurrTS()
 {
+#ifdef _PROCESS_CUSTOM_CLOCK
+    if (_clock)
+        return _clock->now();
+#endif
     return TIMESTAMP();
 }
 
+#ifdef _PROCESS_CUSTOM_CLOCK
+void Scheduler::setClock(ProcessClock *clock)
+{
+    _clock = clock;
+}
+
+ProcessClock *Scheduler::getClock()
+{
+    return _clock;
+}
+#endif
+
 Process *Scheduler::getActive()
 {
     return _active;
@@ -49,20 +108,20 @@ bool Scheduler::isRunningProcess(Process &process)
 
 Process *Scheduler::findProcById(uint8_t id)
 {
-    for (uint8_t i=0; i < NUM_PRIORITY_LEVELS; i++)
-    {
-        for (Process *serv = _pLevels[i].head; serv != NULL; serv = serv->getNext())
-        {
-            if (serv->getID() == id)
-                return serv;
-        }
-    }
-    return NULL;
+#if SCHEDULER_MAX_PROCESSES < 255
+    if (id == 0 || id > SCHEDULER_MAX_PROCESSES)
+#else
+    // Every other id is in the table
+    if (id == 0)
+#endif
+        return NULL;
+
+    return _procTable[id - 1];
 }
 
 bool Scheduler::isNotDestroyed(Process &process)
 {
-    return findNode(process);
+    return process.getID() && findProcById(process.getID()) == &process;
 }
 
 bool Scheduler::isEnabled(Process &process)
@@ -72,21 +131,18 @@ bool Scheduler::isEnabled(Process &process)
 
 bool Scheduler::disable(Process &process)
 {
-    QueableOperation op(&process, QueableOperation::DISABLE_SERVICE);
-    return op.queue(_queue);
+    return queueOperation(process, QueableOperation::DISABLE_SERVICE);
 }
 
 
 bool Scheduler::enable(Process &process)
 {
-    QueableOperation op(&process, QueableOperation::ENABLE_SERVICE);
-    return op.queue(_queue);
+    return queueOperation(process, QueableOperation::ENABLE_SERVICE);
 }
 
 bool Scheduler::add(Process &process, bool enableIfNot)
 {
-    QueableOperation op(&process, QueableOperation::ADD_SERVICE);
-    bool ret = op.queue(_queue);
+    bool ret = queueOperation(process, QueableOperation::ADD_SERVICE);
     if (ret && enableIfNot)
         ret &= enable(process);
     return ret;
@@ -94,23 +150,191 @@ bool Scheduler::add(Process &process, bool enableIfNot)
 
 bool Scheduler::destroy(Process &process)
 {
-    QueableOperation op(&process, QueableOperation::DESTROY_SERVICE);
-    return op.queue(_queue);
+    return queueOperation(process, QueableOperation::DESTROY_SERVICE);
 }
 
 
 bool Scheduler::restart(Process &process)
 {
-    QueableOperation op(&process, QueableOperation::RESTART_SERVICE);
-    return op.queue(_queue);
+    return queueOperation(process, QueableOperation::RESTART_SERVICE);
+}
+
+bool Scheduler::add(ProcessGroup &group, bool enableIfNot)
+{
+    bool ret = queueOperation(group, QueableOperation::ADD_SERVICE);
+    if (ret && enableIfNot)
+        ret &= enable(group);
+    return ret;
+}
+
+bool Scheduler::disable(ProcessGroup &group)
+{
+    return queueOperation(group, QueableOperation::DISABLE_SERVICE);
+}
+
+bool Scheduler::enable(ProcessGroup &group)
+{
+    return queueOperation(group, QueableOperation::ENABLE_SERVICE);
+}
+
+bool Scheduler::destroy(ProcessGroup &group)
+{
+    return queueOperation(group, QueableOperation::DESTROY_SERVICE);
+}
+
+bool Scheduler::restart(ProcessGroup &group)
+{
+    return queueOperation(group, QueableOperation::RESTART_SERVICE);
+}
+
+bool Scheduler::reschedule(Process &process)
+{
+    return queueOperation(process, QueableOperation::RESCHEDULE_SERVICE);
 }
 
 bool Scheduler::halt()
 {
     QueableOperation op(QueableOperation::HALT);
-    return op.queue(_queue);
+    return queueOperation(op);
+}
+
+uint8_t Scheduler::getQueueHighWaterMark()
+{
+    return _queueHighWater;
+}
+
+uint16_t Scheduler::getDroppedOperations()
+{
+    uint16_t dropped;
+    ATOMIC_START
+    {
+        dropped = _queueDropped;
+    }
+    ATOMIC_END
+    return dropped;
+}
+
+void Scheduler::resetQueueStats()
+{
+    ATOMIC_START
+    {
+        _queueHighWater = 0;
+        _queueDropped = 0;
+    }
+    ATOMIC_END
+}
+
+#ifdef _PROCESS_TRACE
+uint16_t Scheduler::readTrace(TraceRecord *records, uint16_t max)
+{
+    uint16_t count = _traceCount < max ? _traceCount : max;
+    // The oldest record is _traceCount behind the head
+    uint16_t tail = _traceHead - _traceCount;
+
+    for (uint16_t i = 0; i < count; i++)
+        records[i] = _trace[(tail + i) & (SCHEDULER_TRACE_SIZE - 1)];
+
+    _traceCount -= count;
+    return count;
+}
+
+uint16_t Scheduler::getTraceLost()
+{
+    return _traceLost;
+}
+
+void Scheduler::resetTrace()
+{
+    _traceHead = 0;
+    _traceCount = 0;
+    _traceLost = 0;
+}
+
+void Scheduler::trace(TraceEvent event, uint8_t id, uint16_t arg)
+{
+    TraceRecord &rec = _trace[_traceHead & (SCHEDULER_TRACE_SIZE - 1)];
+    rec.ts = getCurrTS();
+    rec.event = event;
+    rec.id = id;
+    rec.arg = arg;
+
+    _traceHead++;
+    if (_traceCount < SCHEDULER_TRACE_SIZE)
+        _traceCount++;
+    else if (_traceLost != 0xFFFF)
+        _traceLost++;
+}
+#endif
+
+#ifdef _PROCESS_COROUTINES
+ProcessSleep Scheduler::sleep(uint32_t time)
+{
+    ProcessSleep sleep = {time};
+    return sleep;
+}
+#endif
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+uint16_t Scheduler::getUtilization(int priority)
+{
+    uint16_t util = 0;
+    for (uint8_t i = (priority == ALL_PRIORITY_LEVELS) ? 0 : (uint8_t)priority; i < NUM_PRIORITY_LEVELS; i++)
+    {
+        util += _pLevels[i].util;
+        if (priority != ALL_PRIORITY_LEVELS)
+            break;
+    }
+
+    return util;
+}
+
+// n(2^(1/n) - 1) rounded down, for n = 1 to 10 (UTILIZATION_ONE = 1024)
+static const uint16_t liuLaylandBounds[] = {1024, 848, 798, 774, 761, 752, 746, 741, 737, 734};
+// What it approaches, ln(2)
+#define LIU_LAYLAND_LIMIT 709
+
+static uint16_t liuLaylandBound(uint8_t n)
+{
+    if (!n)
+        return UTILIZATION_ONE;
+    if (n > sizeof(liuLaylandBounds) / sizeof(liuLaylandBounds[0]))
+        return LIU_LAYLAND_LIMIT;
+    return liuLaylandBounds[n - 1];
+}
+
+uint16_t Scheduler::getUtilizationBound()
+{
+    return _utilBound == UTILIZATION_BOUND_LIU_LAYLAND ? liuLaylandBound(_utilCount) : _utilBound;
+}
+
+void Scheduler::setUtilizationBound(uint16_t bound)
+{
+    _utilBound = bound;
+}
+
+void Scheduler::setAdmissionMode(AdmissionMode mode)
+{
+    _admissionMode = mode;
 }
 
+AdmissionMode Scheduler::getAdmissionMode()
+{
+    return _admissionMode;
+}
+
+bool Scheduler::isSchedulable(Process &process)
+{
+    uint16_t util = process.getUtilization();
+
+    // Swap out what is counted for it now, if anything
+    uint32_t total = (uint32_t)getUtilization() - process._util + util;
+    uint8_t count = _utilCount - (process._util != 0) + (util != 0);
+
+    uint16_t bound = _utilBound == UTILIZATION_BOUND_LIU_LAYLAND ? liuLaylandBound(count) : _utilBound;
+    return total <= bound;
+}
+#endif
+
 uint8_t Scheduler::getID(Process &process)
 {
     return process.getID();
@@ -120,6 +344,14 @@ uint8_t Scheduler::countProcesses(int priority, bool enabledOnly)
 {
 
     uint8_t count=0;
+#ifdef _PROCESS_COMPACT
+    for (uint8_t i = 0; i < SCHEDULER_MAX_PROCESSES; i++)
+    {
+        Process *curr = _procTable[i];
+        if (curr && (priority == ALL_PRIORITY_LEVELS || curr->getPriority() == priority))
+            count += enabledOnly ? curr->isEnabled() : 1;
+    }
+#else
     for (uint8_t i = (priority == ALL_PRIORITY_LEVELS) ? 0 : (uint8_t)priority; i < NUM_PRIORITY_LEVELS; i++)
     {
         for (Process *curr = _pLevels[i].head; curr != NULL; curr = curr->getNext())
@@ -129,6 +361,7 @@ uint8_t Scheduler::countProcesses(int priority, bool enabledOnly)
         if (priority != ALL_PRIORITY_LEVELS)
             break;
     }
+#endif
 
     return count;
 }
@@ -136,115 +369,418 @@ uint8_t Scheduler::countProcesses(int priority, bool enabledOnly)
 
 int Scheduler::run()
 {
-    // Already running in another call frame
-    if (_active) return 0;
+    return runPolicy<FixedPriorityPolicy>();
+}
 
-    uint8_t count = 0;
-    uint32_t start = getCurrTS();
-    for (uint8_t pLevel=0; pLevel < NUM_PRIORITY_LEVELS; pLevel++)
+int Scheduler::runFor(uint32_t budget)
+{
+    return runPolicy<FixedPriorityPolicy>(budget);
+}
+
+int Scheduler::runUntilIdle()
+{
+    return runFor(RUN_BUDGET_UNLIMITED);
+}
+
+
+int Scheduler::runOrSleep()
+{
+    int count = run();
+
+    // Nothing was due, sleep until something is
+    if (!count && !_active)
+        idleUntilNextRun();
+
+    return count;
+}
+
+
+uint32_t Scheduler::timeUntilNextRun()
+{
+    // Pending jobs might make something due
+    if (!_queue.isEmpty())
+        return 0;
+
+    // Something was already released
+    for (uint8_t pLevel = 0; pLevel < NUM_PRIORITY_LEVELS; pLevel++)
+    {
+        if (_pLevels[pLevel].heap)
+            return 0;
+    }
+
+    // Only the top of the sleep heap can be the soonest
+    Process *top = _sleepHeap;
+    if (!top)
+        return NEXT_RUN_NEVER;
+
+    int32_t ttnr = (pTimeDiff_t)(top->_heapKey - (pTime_t)getCurrTS());
+    if (top->_heapForced || ttnr <= 0)
+        return 0;
+
+    return ttnr;
+}
+
+
+Process *Scheduler::popReady(uint32_t now)
+{
+#ifndef _PROCESS_AGING
+    (void)now; // Only aging looks at the time
+#endif
+    uint8_t pick = nextLevel();
+
+#ifdef _PROCESS_AGING
+    // A level that waited too long goes first instead
+    uint8_t first = pick;
+    pick = agedLevel(pick, now);
+    if (pick != first)
+        _pLevels[pick].boosts++;
+#endif
+
+    if (pick == NUM_PRIORITY_LEVELS)
+        return NULL;
+
+#ifdef _PROCESS_FAIR_SHARE
+    _chargeLevel = pick;
+#endif
+
+    Process *top = heapPop(pick);
+#if defined(_PROCESS_AGING) && defined(_PROCESS_TRACE)
+    if (pick != first)
+        trace(TRACE_AGING_BOOST, top->getID(), pick);
+#endif
+    return top;
+}
+
+
+uint8_t Scheduler::nextLevel()
+{
+#ifdef _PROCESS_FAIR_SHARE
+    if (_fairShare)
+        return fairShareLevel();
+#endif
+
+    for (uint8_t pLevel = 0; pLevel < NUM_PRIORITY_LEVELS; pLevel++)
     {
-        processQueue();
+        if (_pLevels[pLevel].heap)
+            return pLevel;
+    }
+
+    return NUM_PRIORITY_LEVELS;
+}
 
-        // Resume looking where we left off in the list
-        Process *torun = getRunnable(start, _pLevels[pLevel].next, NULL);
 
-        if (!torun && _pLevels[pLevel].next != _pLevels[pLevel].head)
-            torun = getRunnable(start, _pLevels[pLevel].head, _pLevels[pLevel].next);
+#ifdef _PROCESS_FAIR_SHARE
+uint8_t Scheduler::fairShareLevel()
+{
+    uint8_t first = NUM_PRIORITY_LEVELS;
+    uint32_t rounds = 0;
 
-        // No ready process found at this priority level
-        if (!torun)
+    for (uint8_t pLevel = 0; pLevel < NUM_PRIORITY_LEVELS; pLevel++)
+    {
+        SchedulerPriorityLevel &level = _pLevels[pLevel];
+        if (!level.heap)
             continue;
 
-        _pLevels[pLevel].next = torun->hasNext() ? torun->getNext() : _pLevels[pLevel].head;
+        if (first == NUM_PRIORITY_LEVELS)
+            first = pLevel;
 
-        /////////// Run the correct process /////////
-        _active = torun;
-        start = getCurrTS(); //update
-        bool force = _active->forceSet(); // Store whether it was a forced iteraiton
-        _active->willService(start);
+        if (!level.share)
+            continue;
+        if (level.deficit > 0)
+            return pLevel;
+
+        // How many rounds until it has time again
+        uint32_t quantum = (uint32_t)level.share * FAIR_SHARE_QUANTUM;
+        uint32_t need = (uint32_t)(1 - level.deficit + quantum - 1) / quantum;
+        if (!rounds || need < rounds)
+            rounds = need;
+    }
 
-#ifdef _PROCESS_EXCEPTION_HANDLING
-        int ret = setjmp(_env);
+    // Only levels without a share are ready, or nothing is
+    if (!rounds)
+        return first;
 
-    // Enable the interrupts
-    #ifdef _PROCESS_TIMEOUT_INTERRUPTS
-        ENABLE_SCHEDULER_ISR();
-    #endif
+    // Skip ahead to the round where a ready level has time again
+    uint8_t pick = NUM_PRIORITY_LEVELS;
+    for (uint8_t pLevel = 0; pLevel < NUM_PRIORITY_LEVELS; pLevel++)
+    {
+        SchedulerPriorityLevel &level = _pLevels[pLevel];
+        int32_t quantum = (int32_t)level.share * FAIR_SHARE_QUANTUM;
+        level.deficit += (int32_t)rounds * quantum;
+
+        if (!level.heap) {
+            // A level with nothing to do can only save up one round, so it can start right away
+            // once something is ready, but can't make up for the time it was idle
+            if (level.deficit > quantum)
+                level.deficit = quantum;
+        } else if (level.deficit > 0 && pick == NUM_PRIORITY_LEVELS) {
+            pick = pLevel;
+        }
+    }
 
-        if (!ret) {
-            _active->service();
-        } else {
-            jmpHandler(ret);
+    return pick;
+}
+
+void Scheduler::setLevelShare(uint8_t level, uint8_t share)
+{
+    _pLevels[level].share = share;
+    _pLevels[level].deficit = 0;
+
+    _fairShare = false;
+    for (uint8_t i = 0; i < NUM_PRIORITY_LEVELS; i++)
+        _fairShare |= _pLevels[i].share != 0;
+}
+
+uint8_t Scheduler::getLevelShare(uint8_t level)
+{
+    return _pLevels[level].share;
+}
+#endif
+
+
+#ifdef _PROCESS_TIMER_SLACK
+uint32_t Scheduler::getWakeupCount()
+{
+    return _wakeups;
+}
+
+uint32_t Scheduler::getWakeupsSaved()
+{
+    return _wakeupsSaved;
+}
+
+void Scheduler::resetWakeupStats()
+{
+    _wakeups = 0;
+    _wakeupsSaved = 0;
+}
+#endif
+
+
+#ifdef _PROCESS_AGING
+uint8_t Scheduler::agedLevel(uint8_t pick, uint32_t now)
+{
+    uint8_t starved = NUM_PRIORITY_LEVELS;
+
+    for (uint8_t pLevel = 0; pLevel < NUM_PRIORITY_LEVELS; pLevel++)
+    {
+        SchedulerPriorityLevel &level = _pLevels[pLevel];
+        if (!level.heap) {
+            level.waiting = false;
+            continue;
         }
-#else
+
+        // Its wait starts once something is ready
+        if (!level.waiting) {
+            level.waiting = true;
+            level.waitingSince = now;
+            level.passed = 0;
+        }
+
+        if (pLevel != pick && starved == NUM_PRIORITY_LEVELS && isStarved(pLevel, now))
+            starved = pLevel;
+    }
+
+    if (starved != NUM_PRIORITY_LEVELS)
+        pick = starved;
+
+    for (uint8_t pLevel = 0; pLevel < NUM_PRIORITY_LEVELS; pLevel++)
+    {
+        SchedulerPriorityLevel &level = _pLevels[pLevel];
+        if (!level.waiting)
+            continue;
+
+        if (pLevel != pick) {
+            if (level.passed != 0xFFFF)
+                level.passed++;
+            continue;
+        }
+
+        // Its turn, the wait starts over
+        if (now - level.waitingSince > level.longestWait)
+            level.longestWait = now - level.waitingSince;
+        level.waitingSince = now;
+        level.passed = 0;
+    }
+
+    return pick;
+}
+
+bool Scheduler::isStarved(uint8_t level, uint32_t now)
+{
+    return (_agingWait != AGING_OFF && now - _pLevels[level].waitingSince >= _agingWait) ||
+        (_agingPassed != AGING_OFF && _pLevels[level].passed >= _agingPassed);
+}
+
+void Scheduler::setAging(uint32_t maxWait, uint16_t maxPassed)
+{
+    _agingWait = maxWait;
+    _agingPassed = maxPassed;
+}
+
+uint16_t Scheduler::getStarvationCount(uint8_t level)
+{
+    return _pLevels[level].boosts;
+}
+
+uint32_t Scheduler::getLongestWait(uint8_t level)
+{
+    uint32_t wait = _pLevels[level].waiting ? getCurrTS() - _pLevels[level].waitingSince : 0;
+    return wait > _pLevels[level].longestWait ? wait : _pLevels[level].longestWait;
+}
+
+void Scheduler::resetStarvationStats()
+{
+    for (uint8_t i = 0; i < NUM_PRIORITY_LEVELS; i++)
+    {
+        _pLevels[i].boosts = 0;
+        _pLevels[i].longestWait = 0;
+    }
+}
+#endif
+
+
+void Scheduler::dispatch(Process &process)
+{
+    /////////// Run the correct process /////////
+    _active = &process;
+    uint32_t start = getCurrTS(); //update
+    bool force = _active->forceSet(); // Store whether it was a forced iteraiton
+#ifdef _PROCESS_RESUMABLE
+    // Waking a suspended process up early does not make its iteration a forced one
+    if (_active->_resume)
+        force = false;
+#endif
+    _active->willService(start);
+#ifdef _PROCESS_TRACE
+    trace(TRACE_DISPATCH_START, _active->getID(), force);
+#endif
+
+#ifdef _PROCESS_EXCEPTION_HANDLING
+    int ret = setjmp(_env);
+
+    if (!ret) {
+        // Enable the interrupts, not again after a longjmp so a slow handleException() is not interrupted too
+        #ifdef _PROCESS_TIMEOUT_INTERRUPTS
+        ENABLE_SCHEDULER_ISR();
+        #endif
         _active->service();
+    } else {
+        jmpHandler(ret);
+    }
+#else
+    _active->service();
 #endif
 
 // Disable the interrupts after the process returned
 #ifdef _PROCESS_TIMEOUT_INTERRUPTS
-            DISABLE_SCHEDULER_ISR();
+    DISABLE_SCHEDULER_ISR();
 #endif
-        //////////////////////END PROCESS SERVICING//////////////////////
-
-#ifdef _PROCESS_STATISTICS
-        uint32_t runTime = getCurrTS() - start;
-        // Make sure no overflow happens
-        if (_active->statsWillOverflow(1, runTime))
-            handleHistOverFlow(HISTORY_DIV_FACTOR);
 
-        _active->setHistIterations(_active->getHistIterations()+1);
-        _active->setHistRuntime(_active->getHistRunTime()+runTime);
+#ifdef _PROCESS_CUSTOM_CLOCK
+    // Lets a simulated clock charge it some run time
+    if (_clock)
+        _clock->serviced(*_active);
+#endif
 
+#ifdef _PROCESS_FAIR_SHARE
+    if (_fairShare) {
+        // Anything quicker than a timestamp still costs one, or it would run for free
+        uint32_t used = getCurrTS() - start;
+        _pLevels[_chargeLevel].deficit -= (int32_t)(used ? used : 1);
+    }
 #endif
-        // Is it time to disable?
-        if (_active->wasServiced(force)) {
-            disable(*_active);
-        }
-        _active = NULL; //done!
+    //////////////////////END PROCESS SERVICING//////////////////////
 
-        count++; // incr counter
-        processQueue();
-        delay(0); // For esp8266
-        break; // We found the process and serviced it, so were done
+#ifdef _PROCESS_STATISTICS
+    uint32_t runTime = getCurrTS() - start;
+    // Make sure no overflow happens
+    if (_active->statsWillOverflow(1, runTime))
+        handleHistOverFlow(HISTORY_DIV_FACTOR);
+
+    _active->setHistIterations(_active->getHistIterations()+1);
+    _active->setHistRuntime(_active->getHistRunTime()+runTime);
+    _active->countRunTime(runTime);
+    _active->_load.count(start + runTime, runTime);
+    _load.count(start + runTime, runTime);
+    _busyTime += runTime;
+
+    #ifdef _PROCESS_ADMISSION_CONTROL
+    if (runTime > _active->getWorstCaseRunTime()) {
+        _active->raiseWorstCaseRunTime(runTime);
+        updateUtilization(*_active);
     }
-    delay(0); // For esp8266
+    #endif
 
-    return count;
+#endif
+    // Is it time to disable?
+    bool done = _active->wasServiced(force);
+    if (done) {
+        disable(*_active);
+    } else {
+        schedule(*_active); // Back to sleep until its next iteration
+    }
+#ifdef _PROCESS_TRACE
+    trace(TRACE_DISPATCH_END, _active->getID(), done);
+#endif
+    _active = NULL; //done!
+
+    delay(0); // For esp8266
 }
 
 
-// end is exclusive, end=NULL means go to entire end of list
-Process *Scheduler::getRunnable(uint32_t start, Process *begin, Process *end)
+/************ PROTECTED ***************/
+void Scheduler::idleUntilNextRun()
 {
-    if (!start)
-        return NULL;
+#ifdef _PROCESS_STATISTICS
+    uint32_t start = getCurrTS();
+#endif
+    idle(timeUntilNextRun());
+#ifdef _PROCESS_STATISTICS
+    uint32_t end = getCurrTS();
+    _idleLoad.count(end, end - start);
+    _idleTime += end - start;
+#endif
+}
 
-    Process *torun = NULL;
-    Process *tmp = begin;
 
-    // Search for the best process
-    while(tmp != end) {
-        if (tmp->needsServicing(start)) {
-            if (torun) { //Compare which one needs to run more
-                torun = Process::runWhich(torun, tmp);
-            } else { //torun is NULL so this is the best one to run
-                torun = tmp;
-            }
+void Scheduler::idle(uint32_t timeout)
+{
+    uint32_t start = getCurrTS();
+    while (getCurrTS() - start < timeout)
+    {
+        // Check with interrupts off, so a job can't get queued right before we sleep
+        noInterrupts();
+        if (!_queue.isEmpty()) {
+            interrupts();
+            return;
         }
-
-        tmp = tmp->getNext();
+#ifdef _PROCESS_CUSTOM_CLOCK
+        // Time is up to the clock
+        if (_clock) {
+            interrupts();
+            uint32_t before = getCurrTS();
+            _clock->idle(timeout - (before - start));
+            // Stopped, ex: a VirtualClock with nothing scheduled
+            if (getCurrTS() == before)
+                return;
+            continue;
+        }
+#endif
+        IDLE_PROCESSOR(timeout - (getCurrTS() - start)); // Wakes on any interrupt, interrupts are enabled again
     }
-
-    return torun;
 }
 
 
-/************ PROTECTED ***************/
 void Scheduler::procDisable(Process &process)
 {
     if (process.isEnabled() && isNotDestroyed(process)) {
         process.onDisable();
         process.setDisabled();
+        heapRemove(process);
+#ifdef _PROCESS_ADMISSION_CONTROL
+        updateUtilization(process);
+#endif
     }
 }
 
@@ -252,9 +788,17 @@ void Scheduler::procDisable(Process &process)
 void Scheduler::procEnable(Process &process)
 {
     if (!process.isEnabled() && isNotDestroyed(process)) {
-        process.resetTimeStamps();
+#ifdef _PROCESS_ADMISSION_CONTROL
+        if (!procAdmit(process))
+            return;
+#endif
+        process.initTimeStamps();
         process.onEnable();
         process.setEnabled();
+        schedule(process);
+#ifdef _PROCESS_ADMISSION_CONTROL
+        updateUtilization(process);
+#endif
     }
 }
 
@@ -265,6 +809,13 @@ void Scheduler::procDestroy(Process &process)
         procDisable(process);
         process.cleanup();
         removeNode(process);
+#ifdef _PROCESS_RESUMABLE
+        process.dropSuspended();
+#endif
+
+        // Give back its id
+        _procTable[process.getID() - 1] = NULL;
+        _freeIDs[(_freeHead + _freeCount++) % SCHEDULER_MAX_PROCESSES] = process.getID();
         process.setID(0);
     }
 }
@@ -272,31 +823,165 @@ void Scheduler::procDestroy(Process &process)
 
 void Scheduler::procRestart(Process &process)
 {
-    if (isNotDestroyed(process)) {
-        procDisable(process);
-        process.cleanup();
+    if (!isNotDestroyed(process)) {
+        // Same as add() and enable()
+        procAdd(process);
+        procEnable(process);
+        return;
     }
-    process.resetTimeStamps();
+
+    procDisable(process);
+    process.cleanup();
+#ifdef _PROCESS_RESUMABLE
+    process.dropSuspended();
+#endif
+    process.initTimeStamps();
     process.setup();
     procEnable(process);
 }
 
 
+void Scheduler::procReschedule(Process &process)
+{
+    // Take a fresh snapshot of when it is due, it waits in the sleep heap again
+    heapRemove(process);
+    if (isNotDestroyed(process))
+        schedule(process);
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+    // Its period or worst case run time might have changed
+    if (process.isEnabled()) {
+        if (_admissionMode != ADMISSION_OFF && !isSchedulable(process))
+            process.raiseWarning(WARNING_PROC_UNSCHEDULABLE);
+        updateUtilization(process);
+    }
+#endif
+}
+
+
 void Scheduler::procAdd(Process &process)
 {
-    if (!isNotDestroyed(process)) {
-        for (; process.getID() == 0 || findProcById(process.getID()) != NULL; process.setID(++_lastID)); // Find a free id
-        process.resetTimeStamps();
+    if (!isNotDestroyed(process) && _freeCount) {
+        // Take the next free id
+        process.setID(_freeIDs[_freeHead]);
+        _freeHead = (_freeHead + 1) % SCHEDULER_MAX_PROCESSES;
+        _freeCount--;
+        _procTable[process.getID() - 1] = &process;
+
+        process.initTimeStamps();
         process.setup();
-        procEnable(process);
         appendNode(process);
 
 #ifdef _PROCESS_STATISTICS
         process.setHistRuntime(0);
         process.setHistIterations(0);
-        process.setHistLoadPercent(0);
+        process._load.reset(getCurrTS());
+        process.resetRunTimeStats();
+#endif
+    }
+}
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+bool Scheduler::procAdmit(Process &process)
+{
+    if (_admissionMode == ADMISSION_OFF || isSchedulable(process))
+        return true;
+
+    process.raiseWarning(WARNING_PROC_UNSCHEDULABLE);
+    return _admissionMode != ADMISSION_REFUSE;
+}
+
+void Scheduler::updateUtilization(Process &process)
+{
+    uint16_t util = process.isEnabled() ? process.getUtilization() : 0;
+
+    _pLevels[process.getPriority()].util += util - process._util;
+    _utilCount += (util != 0) - (process._util != 0);
+    process._util = util;
+}
+#endif
+
+uint8_t Scheduler::takePending(volatile uint8_t &pending)
+{
+    // Take everything pending, anything queued from now on needs a new job
+    uint8_t ops;
+    do {
+        ops = pending;
+    } while (!atomicCompareSwap(&pending, ops, (uint8_t)0));
+    return ops;
+}
+
+void Scheduler::procPending(Process &process)
+{
+    applyPending(process, takePending(process._queuedOps), QueableOperation::PENDING_SERVICE);
+}
+
+void Scheduler::procGroupPending(ProcessGroup &group)
+{
+    // Everything in the group gets the same operations, before anything else runs
+    uint8_t ops = takePending(group._queuedOps);
+
+    for (uint8_t i = 0; i < group.getCount(); i++)
+    {
+        Process *process = group.getMember(i);
+        if (!process)
+            continue;
+
+        applyPending(*process, ops, QueableOperation::GROUP_PENDING_SERVICE);
+    }
+}
+
+void Scheduler::applyPending(Process &process, uint8_t ops, QueableOperation::OperationType job)
+{
+#ifdef _PROCESS_TRACE
+    // A process waiting to be added has no id yet
+    uint8_t id = process.getID();
+#else
+    (void)job; // Only traced
 #endif
+
+    uint8_t pre = (ops >> QueableOperation::PENDING_PRE_SHIFT) & QueableOperation::PENDING_ENABLE_MASK;
+    uint8_t post = (ops >> QueableOperation::PENDING_POST_SHIFT) & QueableOperation::PENDING_ENABLE_MASK;
+
+    if (pre == QueableOperation::PENDING_ENABLE)
+        procEnable(process);
+    else if (pre == QueableOperation::PENDING_DISABLE)
+        procDisable(process);
+
+    switch (ops & QueableOperation::PENDING_LIFECYCLE_MASK)
+    {
+        case QueableOperation::PENDING_ADD:
+            procAdd(process);
+            break;
+
+        case QueableOperation::PENDING_DESTROY:
+            procDestroy(process);
+            break;
+
+        case QueableOperation::PENDING_DESTROY_ADD:
+            procDestroy(process);
+            procAdd(process);
+            break;
+
+        case QueableOperation::PENDING_RESTART:
+            procRestart(process);
+            break;
+
+        default:
+            break;
     }
+
+    if (post == QueableOperation::PENDING_ENABLE)
+        procEnable(process);
+    else if (post == QueableOperation::PENDING_DISABLE)
+        procDisable(process);
+
+    if (ops & QueableOperation::PENDING_RESCHEDULE)
+        procReschedule(process);
+
+#ifdef _PROCESS_TRACE
+    trace(TRACE_JOB, id ? id : process.getID(), job | ops << 8);
+#endif
 }
 
 void Scheduler::procHalt()
@@ -304,10 +989,16 @@ void Scheduler::procHalt()
 
     for (uint8_t i = 0; i < NUM_PRIORITY_LEVELS; i++)
     {
-        for (Process *curr = _pLevels[i].head; curr != NULL; curr = curr->getNext())
+#ifdef _PROCESS_COMPACT
+        for (uint8_t j = 0; j < SCHEDULER_MAX_PROCESSES; j++)
         {
-            procDestroy(*curr);
+            if (_procTable[j] && _procTable[j]->getPriority() == i)
+                procDestroy(*_procTable[j]);
         }
+#else
+        while (_pLevels[i].head)
+            procDestroy(*_pLevels[i].head);
+#endif
     }
 
     delay(100);
@@ -326,118 +1017,256 @@ Scheduler::QueableOperation::QueableOperation(Scheduler::QueableOperation::Queab
 Scheduler::QueableOperation::QueableOperation(Process *serv, Scheduler::QueableOperation::QueableOperation::OperationType op)
     : _process(serv), _operation(static_cast<uint8_t>(op)) {}
 
+Scheduler::QueableOperation::QueableOperation(ProcessGroup *group, Scheduler::QueableOperation::QueableOperation::OperationType op)
+    : _group(group), _operation(static_cast<uint8_t>(op)) {}
+
 Process *Scheduler::QueableOperation::getProcess()
 {
     return _process;
 }
 
+ProcessGroup *Scheduler::QueableOperation::getGroup()
+{
+    return _group;
+}
+
 Scheduler::QueableOperation::QueableOperation::OperationType Scheduler::QueableOperation::getOperation()
 {
     return static_cast<Scheduler::QueableOperation::QueableOperation::OperationType>(_operation);
 }
 
-bool Scheduler::QueableOperation::queue(RingBuf *queue)
+uint8_t Scheduler::QueableOperation::merge(uint8_t pending, Scheduler::QueableOperation::OperationType op)
 {
-    return queue->add(queue, this) >= 0;
+    uint8_t lifecycle = pending & PENDING_LIFECYCLE_MASK;
+    uint8_t pre = (pending >> PENDING_PRE_SHIFT) & PENDING_ENABLE_MASK;
+    uint8_t post = (pending >> PENDING_POST_SHIFT) & PENDING_ENABLE_MASK;
+    uint8_t reschedule = pending & PENDING_RESCHEDULE;
+
+    switch (op)
+    {
+        case ENABLE_SERVICE:
+            post = PENDING_ENABLE; // Only the last enable/disable matters
+            break;
+
+        case DISABLE_SERVICE:
+            post = PENDING_DISABLE;
+            break;
+
+        case DESTROY_SERVICE:
+            // Whatever was pending, it ends up destroyed
+            lifecycle = PENDING_DESTROY;
+            pre = post = 0;
+            break;
+
+        case RESTART_SERVICE:
+            // Whatever was pending, it ends up added and enabled
+            lifecycle = PENDING_RESTART;
+            pre = post = 0;
+            break;
+
+        case ADD_SERVICE:
+            if (!lifecycle) {
+                // The enable/disable has to happen before the add
+                lifecycle = PENDING_ADD;
+                pre = post;
+                post = 0;
+            } else if (lifecycle == PENDING_DESTROY) {
+                // An enable/disable after a destroy does nothing
+                lifecycle = PENDING_DESTROY_ADD;
+                post = 0;
+            }
+            // Otherwise it is already going to be added, nothing to do
+            break;
+
+        case RESCHEDULE_SERVICE:
+            reschedule = PENDING_RESCHEDULE;
+            break;
+
+        default:
+            break;
+    }
+
+    return lifecycle | (pre << PENDING_PRE_SHIFT) | (post << PENDING_POST_SHIFT) | reschedule;
 }
 
 /* end Queue object garbage */
 
 
+bool Scheduler::queueOperation(const QueableOperation &op)
+{
+    if (!_queue.add(op)) {
+        dropOperation();
+        return false;
+    }
+
+    uint8_t used = _queue.count();
+    if (used > _queueHighWater)
+        _queueHighWater = used;
+
+    return true;
+}
+
+bool Scheduler::queueOperation(Process &process, QueableOperation::OperationType op)
+{
+    return queuePending(process._queuedOps, QueableOperation(&process, QueableOperation::PENDING_SERVICE), op);
+}
+
+bool Scheduler::queueOperation(ProcessGroup &group, QueableOperation::OperationType op)
+{
+    return queuePending(group._queuedOps, QueableOperation(&group, QueableOperation::GROUP_PENDING_SERVICE), op);
+}
+
+// Lock free, there is at most one job in the queue for each process or group
+bool Scheduler::queuePending(volatile uint8_t &queuedOps, const QueableOperation &job, QueableOperation::OperationType op)
+{
+    for (;;)
+    {
+        uint8_t pending = queuedOps;
+
+        if (pending) {
+            // Already has a job in the queue, fold this one into it
+            if (atomicCompareSwap(&queuedOps, pending, QueableOperation::merge(pending, op)))
+                return true;
+            continue;
+        }
+
+        // Needs a job in the queue, reserve it before marking it as pending
+        queue_index_t pos;
+        if (!_queue.claim(pos)) {
+            dropOperation();
+            return false;
+        }
+
+        uint8_t used = _queue.count();
+        if (used > _queueHighWater)
+            _queueHighWater = used;
+
+        if (atomicCompareSwap(&queuedOps, (uint8_t)0, QueableOperation::merge(0, op))) {
+            _queue.publish(pos, job);
+            return true;
+        }
+
+        // Someone else queued it first, the claimed job is not needed
+        _queue.publish(pos, QueableOperation());
+    }
+}
+
+void Scheduler::dropOperation()
+{
+    uint16_t dropped;
+    do {
+        dropped = _queueDropped;
+    } while (!atomicCompareSwap(&_queueDropped, dropped, (uint16_t)(dropped + 1)));
+}
+
+
 //Only call when there is guarantee this is not running in another call frame
 void Scheduler::processQueue()
 {
-    while(!_queue->isEmpty(_queue)) // Empty Queue
+    while(!_queue.isEmpty()) // Empty Queue
     {
         QueableOperation op;
-        _queue->pull(_queue, &op);
+        _queue.pull(op);
         switch (op.getOperation())
         {
-            case QueableOperation::ENABLE_SERVICE:
-                procEnable(*op.getProcess());
-                break;
-
-            case QueableOperation::DISABLE_SERVICE:
-                procDisable(*op.getProcess());
-                break;
-
-            case QueableOperation::ADD_SERVICE:
-                procAdd(*op.getProcess());
-                break;
-
-            case QueableOperation::DESTROY_SERVICE:
-                procDestroy(*op.getProcess());
+            case QueableOperation::PENDING_SERVICE:
+                procPending(*op.getProcess());
                 break;
 
-            case QueableOperation::RESTART_SERVICE:
-                procRestart(*op.getProcess());
+            case QueableOperation::GROUP_PENDING_SERVICE:
+                procGroupPending(*op.getGroup());
                 break;
 
             case QueableOperation::HALT:
+#ifdef _PROCESS_TRACE
+                trace(TRACE_JOB, 0, QueableOperation::HALT);
+#endif
                 procHalt();
                 break;
 
-#ifdef _PROCESS_STATISTICS
-            case QueableOperation::UPDATE_STATS:
-                procUpdateStats();
-                break;
-#endif
-
             default:
                 break;
         }
     }
+
+    if (_forceLost)
+        procForceLost();
+}
+
+// A force() found the job queue full, look for the processes it was for
+void Scheduler::procForceLost()
+{
+    _forceLost = false;
+    for (uint8_t i = 0; i < SCHEDULER_MAX_PROCESSES; i++)
+    {
+        Process *p = _procTable[i];
+        if (p && p->forceSet() && !(p->_heapId != HEAP_NONE && p->_heapForced))
+            procReschedule(*p);
+    }
 }
 
 #ifdef _PROCESS_STATISTICS
-bool Scheduler::updateStats()
+uint8_t Scheduler::getLoadPercent()
 {
-    QueableOperation op(QueableOperation::UPDATE_STATS);
-    return op.queue(_queue);
+    return _load.getPercent(getCurrTS());
 }
 
+uint8_t Scheduler::getIdlePercent()
+{
+    return _idleLoad.getPercent(getCurrTS());
+}
 
-void Scheduler::procUpdateStats()
+uint8_t Scheduler::getOverheadPercent()
 {
+    return _overheadLoad.getPercent(getCurrTS());
+}
 
-    uint8_t count = countProcesses(ALL_PRIORITY_LEVELS, false);
-    hTimeCount_t sTime[count];
+sTimeCount_t Scheduler::getBusyTime()
+{
+    return _busyTime;
+}
 
-    // Thread safe in case of interrupts
-    hTimeCount_t totalTime = 0;
-    Process *p;
-    uint8_t i;
+sTimeCount_t Scheduler::getIdleTime()
+{
+    return _idleTime;
+}
 
-    for (uint8_t l = 0; l < NUM_PRIORITY_LEVELS; l++)
-    {
-        for (i = 0, p = _pLevels[l].head; p != NULL && i < count; p = p->getNext(), i++)
-        {
-            // to ensure no overflows
-            sTime[i] = (p->getHistRunTime() + count/2) / count;
-            totalTime += sTime[i];
-        }
-    }
+sTimeCount_t Scheduler::getOverheadTime()
+{
+    return _overheadTime;
+}
 
-    for (uint8_t l = 0; l < NUM_PRIORITY_LEVELS; l++)
-    {
-        for (i = 0, p = _pLevels[l].head; p != NULL && i < count; p = p->getNext(), i++)
-        {
-            // to ensure no overflows have to use double
-            if (!totalTime) {
-                p->setHistLoadPercent(0);
-            } else {
-                double tmp = 100*((double)sTime[i]/(double)totalTime);
-                p->setHistLoadPercent((uint8_t)tmp);
-            }
-        }
-    }
+void Scheduler::resetTimeStats()
+{
+    _busyTime = 0;
+    _idleTime = 0;
+    _overheadTime = 0;
+}
+
+bool Scheduler::updateStats()
+{
+    return true;
+}
+
+void Scheduler::countOverhead(uint32_t enter, uint32_t busy)
+{
+    uint32_t end = getCurrTS();
+    uint32_t overhead = end - enter - busy;
 
-    return;
+    _overheadLoad.count(end, overhead);
+    _overheadTime += overhead;
 }
 
 // Make sure it is locked
 void Scheduler::handleHistOverFlow(uint8_t div)
 {
+#ifdef _PROCESS_COMPACT
+    for (uint8_t i = 0; i < SCHEDULER_MAX_PROCESSES; i++)
+    {
+        if (_procTable[i])
+            _procTable[i]->divStats(div);
+    }
+#else
     for (uint8_t i = 0; i < NUM_PRIORITY_LEVELS; i++)
     {
         for (Process *p = _pLevels[i].head; p != NULL; p = p->getNext())
@@ -445,6 +1274,7 @@ void Scheduler::handleHistOverFlow(uint8_t div)
             p->divStats(div);
         }
     }
+#endif
 
 }
 
@@ -477,6 +1307,9 @@ void Scheduler::handleHistOverFlow(uint8_t div)
             {
 #ifdef _PROCESS_TIMEOUT_INTERRUPTS
                 case LONGJMP_ISR_CODE:
+    #ifdef _PROCESS_TRACE
+                    trace(TRACE_TIMEOUT, _active->getID());
+    #endif
                     _active->handleWarning(ERROR_PROC_TIMED_OUT);
                     break;
 #endif
@@ -485,6 +1318,9 @@ void Scheduler::handleHistOverFlow(uint8_t div)
                     break;
 
                 default:
+#ifdef _PROCESS_TRACE
+                    trace(TRACE_EXCEPTION, _active->getID(), (uint16_t)e);
+#endif
                     if (!_active->handleException(e))
                         handleException(_active, e);
                     break;
@@ -498,62 +1334,259 @@ void Scheduler::handleHistOverFlow(uint8_t div)
 
 
 
+// Without the lists (_PROCESS_COMPACT) _procTable is walked instead, so these do nothing
 bool Scheduler::appendNode(Process &node)
 {
-    node.setNext(NULL);
-
+#ifdef _PROCESS_COMPACT
+    (void)node;
+#else
     ProcPriority p = node.getPriority();
 
+    node.setNext(NULL);
+    node.setPrev(_pLevels[p].tail);
+
     if (!_pLevels[p].head) { // adding to head
         _pLevels[p].head = &node;
-        _pLevels[p].next = &node;
     } else {
-        Process *next = _pLevels[p].head; // adding not to head
-        for(; next->hasNext(); next = next->getNext()); //run through list
-        // Update pointers
-        next->setNext(&node);
+        _pLevels[p].tail->setNext(&node);
     }
+    _pLevels[p].tail = &node;
+#endif
+
     return true;
 }
 
 bool Scheduler::removeNode(Process &node)
 {
+#ifdef _PROCESS_COMPACT
+    (void)node;
+#else
     ProcPriority p = node.getPriority();
 
     if (&node == _pLevels[p].head) { // node is head
         _pLevels[p].head = node.getNext();
     } else {
-        // Find the previous node
-        Process *prev = findPrevNode(node);
-
-        if (!prev)
-            return false; // previous node does not exist
+        node.getPrev()->setNext(node.getNext());
+    }
 
-        prev->setNext(node.getNext());
+    if (&node == _pLevels[p].tail) { // node is tail
+        _pLevels[p].tail = node.getPrev();
+    } else {
+        node.getNext()->setPrev(node.getPrev());
     }
 
-    if (_pLevels[p].next == &node)
-        _pLevels[p].next = node.hasNext() ? node.getNext() : _pLevels[p].head;
+    node.setNext(NULL);
+    node.setPrev(NULL);
+#endif
 
     return true;
 }
 
-bool Scheduler::findNode(Process &node)
+
+// Only schedules processes that are enabled, and have iterations left or are forced
+void Scheduler::schedule(Process &process)
+{
+    if (!process.isEnabled() || process._heapId != HEAP_NONE)
+        return;
+
+    if (!process.forceSet() && process.getIterations() == 0)
+        return;
+
+    // Waiting to be woken up with force()
+    if (!process.forceSet() && process.getPeriod() == SERVICE_ON_EVENT)
+        return;
+
+#ifdef _PROCESS_RESUMABLE
+    // Waiting to be woken up with force()
+    if (!process.forceSet() && process._resume == RESUME_ON_WAKE)
+        return;
+#endif
+
+    uint32_t due;
+    ATOMIC_START
+    {
+        due = dueTS(process);
+    }
+    ATOMIC_END
+
+#ifdef _PROCESS_TIMER_SLACK
+    // Sleep until the end of its window, unless another process wakes up first
+    due += process._slack;
+#endif
+
+    heapPush(process, HEAP_SLEEP, due);
+}
+
+uint32_t Scheduler::dueTS(Process &process)
+{
+#ifdef _PROCESS_RESUMABLE
+    if (process._resume)
+        return process._resumeTS;
+#endif
+    return process._scheduledTS + process._period; // Only the low bits are kept
+}
+
+void Scheduler::heapPush(Process &node, uint8_t heap, uint32_t key)
+{
+    node._heapKey = key;
+    node._heapForced = node.forceSet();
+    node._heapSeq = _heapSeq++;
+    node._heapId = heap;
+
+    Process *&root = heapRoot(heap);
+#ifdef _PROCESS_LINEAR_SCAN
+    if (!root || heapBefore(&node, root))
+        root = &node;
+#else
+    node._heapChild = node._heapNext = node._heapPrev = NULL;
+    root = heapMerge(root, &node);
+#endif
+}
+
+void Scheduler::heapRemove(Process &node)
+{
+    if (node._heapId == HEAP_NONE)
+        return; // not in a heap
+
+    Process *&root = heapRoot(node._heapId);
+
+#ifdef _PROCESS_LINEAR_SCAN
+    uint8_t heap = node._heapId;
+    node._heapId = HEAP_NONE;
+    if (&node == root)
+        root = heapScan(heap);
+#else
+
+    if (&node == root) {
+        heapPop(node._heapId);
+        return;
+    }
+
+    // Unlink it from its siblings
+    if (node._heapPrev->_heapChild == &node)
+        node._heapPrev->_heapChild = node._heapNext;
+    else
+        node._heapPrev->_heapNext = node._heapNext;
+
+    if (node._heapNext)
+        node._heapNext->_heapPrev = node._heapPrev;
+
+    // Then put its children back
+    root = heapMerge(root, heapMergePairs(node._heapChild));
+    node._heapChild = node._heapNext = node._heapPrev = NULL;
+    node._heapId = HEAP_NONE;
+#endif
+}
+
+Process *Scheduler::heapPop(uint8_t heap)
+{
+    Process *&root = heapRoot(heap);
+    Process *top = root;
+
+    if (top) {
+        top->_heapId = HEAP_NONE;
+#ifdef _PROCESS_LINEAR_SCAN
+        root = heapScan(heap);
+#else
+        root = heapMergePairs(top->_heapChild);
+        top->_heapChild = NULL;
+#endif
+    }
+
+    return top;
+}
+
+Process *&Scheduler::heapRoot(uint8_t heap)
+{
+    return heap == HEAP_SLEEP ? _sleepHeap : _pLevels[heap].heap;
+}
+
+// Forced first, then the smallest key, with ties going round robin
+bool Scheduler::heapBefore(Process *p1, Process *p2)
+{
+    if (p1->_heapForced != p2->_heapForced)
+        return p1->_heapForced;
+
+    pTimeDiff_t diff = (pTimeDiff_t)(p1->_heapKey - p2->_heapKey);
+    if (diff)
+        return diff < 0;
+
+    return (int16_t)(p1->_heapSeq - p2->_heapSeq) < 0;
+}
+
+#ifdef _PROCESS_LINEAR_SCAN
+// The first process in heap, the root is only cached
+Process *Scheduler::heapScan(uint8_t heap)
 {
-    for (Process *p = _pLevels[node.getPriority()].head; p != NULL; p = p->getNext())
+    Process *first = NULL;
+    for (uint8_t i = 0; i < SCHEDULER_MAX_PROCESSES; i++)
     {
-        if (p == &node)
-            return true;
+        Process *p = _procTable[i];
+        if (p && p->_heapId == heap && (!first || heapBefore(p, first)))
+            first = p;
+    }
+    return first;
+}
+#else
+// Both must be roots, the loser becomes the first child of the winner
+Process *Scheduler::heapMerge(Process *p1, Process *p2)
+{
+    if (!p1)
+        return p2;
+    if (!p2)
+        return p1;
+
+    if (heapBefore(p2, p1)) {
+        Process *tmp = p1;
+        p1 = p2;
+        p2 = tmp;
     }
-    return false;
+
+    p2->_heapPrev = p1;
+    p2->_heapNext = p1->_heapChild;
+    if (p1->_heapChild)
+        p1->_heapChild->_heapPrev = p2;
+    p1->_heapChild = p2;
+
+    return p1;
 }
 
-Process *Scheduler::findPrevNode(Process &node)
+// Standard two pass pairing, first is a list of siblings
+Process *Scheduler::heapMergePairs(Process *first)
 {
-    Process *prev = _pLevels[node.getPriority()].head;
-    for (; prev != NULL && prev->getNext() != &node; prev = prev->getNext());
-    return prev;
+    Process *pairs = NULL;
+
+    // Left to right, merge each pair and stack the result
+    while (first)
+    {
+        Process *p1 = first;
+        Process *p2 = first->_heapNext;
+        first = p2 ? p2->_heapNext : NULL;
+
+        p1->_heapNext = p1->_heapPrev = NULL;
+        if (p2) {
+            p2->_heapNext = p2->_heapPrev = NULL;
+            p1 = heapMerge(p1, p2);
+        }
+
+        p1->_heapNext = pairs;
+        pairs = p1;
+    }
+
+    // Right to left, merge the stack into one heap
+    Process *root = NULL;
+    while (pairs)
+    {
+        Process *next = pairs->_heapNext;
+        pairs->_heapNext = NULL;
+        root = heapMerge(root, pairs);
+        pairs = next;
+    }
+
+    return root;
 }
+#endif
+
 
 /*
 void Scheduler::reOrderProcs(ProcPriority level)
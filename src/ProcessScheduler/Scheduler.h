@@ -2,15 +2,17 @@
 #define SCHEDULER_H
 
 #include "Includes.h"
-
-typedef struct RingBuf RingBuf;
+#include "JobQueue.h"
+#include "LoadAverage.h"
 
 class Process;
+class ProcessGroup;
 
 
 
 class Scheduler
 {
+    friend class Process;
 
 public:
     Scheduler();
@@ -108,6 +110,20 @@ public:
 
 /*********************** End Processes Methods ********************/
 
+/*************** Methods to Perform Actions on Process Groups ****************/
+// The same as calling the method on every process in the group, except the whole group
+// takes one slot in the job queue, and is switched at once the next time the queue is processed
+// NOTE: These can also be called directly on the ProcessGroup object
+// example group.enable()
+
+    bool add(ProcessGroup &group, bool enableIfNot = false);
+    bool disable(ProcessGroup &group);
+    bool enable(ProcessGroup &group);
+    bool destroy(ProcessGroup &group);
+    bool restart(ProcessGroup &group);
+
+/*********************** End Process Group Methods ********************/
+
 
     /**
     * Destroy all processes then put the processor into a low power sleep state
@@ -143,32 +159,296 @@ public:
     /**
     * Get the internal timestamp the scheduler is using to track time
     * Either the same as millis() or micros() depending on _MICROS_PRECISION
+    * (or whatever the ProcessClock says, see setClock())
     * @return: uint32_t
     */
     static uint32_t getCurrTS();
 
+#ifdef _PROCESS_CUSTOM_CLOCK
+    /**
+    * Read time from clock instead of millis()/micros(), NULL to go back to them
+    * NOTE: Every Scheduler shares the clock, switch it before anything is enabled
+    */
+    static void setClock(ProcessClock *clock);
+
+    /**
+    * Get the clock set with setClock()
+    *
+    * @return: a pointer to the clock, NULL if it is millis()/micros()
+    */
+    static ProcessClock *getClock();
+#endif
+
     /**
     * Run one pass through the scheduler, call this repeatedly in your void loop()
+    * Processes are serviced in strict priority level order, then whichever is most behind
+    * See Policy.h for other scheduling policies
     *
     * @return: The number of processes serviced in that pass
     */
     int run();
 
+    /**
+    * Service every process that is ready, in the same order as run(), until budget is used up
+    * The job queue is drained and the clock is read once for the whole pass, instead of once
+    * per process serviced, so this is cheaper than calling run() when many short processes are
+    * due at once. At least one process is serviced if any is ready, whatever the budget is
+    * NOTE: A process that got ready during the pass waits for the next one
+    *
+    * @return: The number of processes serviced in that pass
+    */
+    int runFor(uint32_t budget);
+
+    /**
+    * Same as runFor() without a budget, service everything that is ready
+    *
+    * @return: The number of processes serviced in that pass
+    */
+    int runUntilIdle();
+
+    /**
+    * Same as run(), except when nothing was serviced the processor is idled
+    * until the next process is due, or an interrupt queues a job (ex: force())
+    * Call this repeatedly in your void loop() instead of run() to save power
+    *
+    * @return: The number of processes serviced in that pass
+    */
+    int runOrSleep();
+
+    /**
+    * Get the time until the next process needs to be serviced
+    * Forced, SERVICE_CONSTANTLY, or behind processes are due now
+    *
+    * @return: uint32_t time, 0 if something is due, NEXT_RUN_NEVER if nothing is scheduled
+    */
+    uint32_t timeUntilNextRun();
+
 
 // Enable this option in config.h to track time statistics on processes
 #ifdef _PROCESS_STATISTICS
     /**
-    * This will update the Process.getLoadPercent() method
-    * It will estimate the % CPU time for all processes
-    * NOTE: This will simply add this task to the scheduler job queue
-    * The update will not happen until the scheduler gets a chance to process the request
+    * Get the % of the processor time spent servicing processes lately, the rest was idle or overhead
+    * Like Process.getLoadPercent(), it is averaged over the last few LOAD_WINDOW_BITS windows
     *
-    * @return: True on success
+    * @return: uint8_t percent
+    */
+    uint8_t getLoadPercent();
+
+    /**
+    * Same as getLoadPercent(), for the time idle in runOrSleep(), and the time run() spent on
+    * anything other than service() (draining the job queue, picking the next process)
+    * Whatever is left of 100% went to the code in between the calls to run()
+    *
+    * @return: uint8_t percent
+    */
+    uint8_t getIdlePercent();
+    uint8_t getOverheadPercent();
+
+    /**
+    * Get the total time spent servicing processes, idle in runOrSleep(), and on overhead
+    * in run(), since the scheduler was created or resetTimeStats() was called
+    * NOTE: Overhead is well under a millisecond per run(), use _MICROS_PRECISION to see it
+    *
+    * @return: sTimeCount_t time
+    */
+    sTimeCount_t getBusyTime();
+    sTimeCount_t getIdleTime();
+    sTimeCount_t getOverheadTime();
+
+    /**
+    * Reset the busy, idle, and overhead totals back to zero
+    */
+    void resetTimeStats();
+
+    /**
+    * Does nothing, the load of every process is kept up to date as it is serviced
+    * Kept so older sketches still build
+    *
+    * @return: True
     */
     bool updateStats();
 
 #endif
 
+// Enable this option in config.h to allow C++20 coroutine processes
+#ifdef _PROCESS_COROUTINES
+    /**
+    * Give up the processor for at least time, from inside a CoProcess task()
+    * ex: co_await scheduler.sleep(50);
+    * A time of 0 just lets the other ready processes have their turn
+    *
+    * @return: Something to co_await
+    */
+    ProcessSleep sleep(uint32_t time);
+#endif
+
+// Enable this option in config.h to have the scheduler check that processes can keep up
+#ifdef _PROCESS_ADMISSION_CONTROL
+    /**
+    * Get the total utilization of the enabled processes at priority levels
+    * If priority = ALL_PRIORITY_LEVELS, add up all priority levels
+    *
+    * @return: uint16_t utilization, UTILIZATION_ONE is the whole processor
+    */
+    uint16_t getUtilization(int priority = ALL_PRIORITY_LEVELS);
+
+    /**
+    * Get the utilization the enabled processes have to stay under
+    * By default this is the Liu & Layland bound n(2^(1/n) - 1), for n enabled processes that
+    * use some of the processor. NOTE: It only guarantees anything if shorter periods have higher priority
+    *
+    * @return: uint16_t utilization, UTILIZATION_ONE is the whole processor
+    */
+    uint16_t getUtilizationBound();
+
+    /**
+    * Set the utilization the enabled processes have to stay under
+    * ex: UTILIZATION_ONE for earliest deadline first, or UTILIZATION_BOUND_LIU_LAYLAND
+    */
+    void setUtilizationBound(uint16_t bound);
+
+    /**
+    * Set what happens when enabling a process would go over the utilization bound
+    * ADMISSION_OFF, ADMISSION_WARN (the default), or ADMISSION_REFUSE
+    */
+    void setAdmissionMode(AdmissionMode mode);
+
+    /**
+    * Get what happens when enabling a process would go over the utilization bound
+    *
+    * @return: AdmissionMode
+    */
+    AdmissionMode getAdmissionMode();
+
+    /**
+    * Determine if the enabled processes would stay under the utilization bound with this process enabled
+    *
+    * @return: bool
+    */
+    bool isSchedulable(Process &process);
+#endif
+
+// Enable this option in config.h to keep lower priority levels from starving
+#ifdef _PROCESS_AGING
+    /**
+    * Once a priority level has had a process ready for maxWait without getting a turn, or has been
+    * passed over maxPassed times, its next process goes ahead of the higher levels (once)
+    * AGING_OFF turns either one off, the defaults are AGING_DEFAULT_WAIT and AGING_DEFAULT_PASSED
+    */
+    void setAging(uint32_t maxWait, uint16_t maxPassed = AGING_OFF);
+
+    /**
+    * Get the number of times a process at priority level had to go ahead because of aging
+    *
+    * @return: uint16_t count
+    */
+    uint16_t getStarvationCount(uint8_t level);
+
+    /**
+    * Get the longest priority level had a process ready without getting a turn
+    * Including the wait it is in right now, if any
+    *
+    * @return: uint32_t time
+    */
+    uint32_t getLongestWait(uint8_t level);
+
+    /**
+    * Reset the starvation counts and longest waits back to zero
+    */
+    void resetStarvationStats();
+#endif
+
+// Enable this option in config.h to split the processor time between priority levels
+#ifdef _PROCESS_FAIR_SHARE
+    /**
+    * Give priority level a share of the processor time, ex: 70, 20, and 10 for the three levels
+    * While every level with a share is busy, each gets its share of the time service() takes.
+    * Within its share a level still goes before the lower ones, and whatever time a level does not
+    * use goes to the others. Levels with a share of 0 only run when the others are out of budget
+    * Once every level is back to 0, it is strict priority levels again (the default)
+    * NOTE: The run time is measured, and each service() costs at least one timestamp, so with
+    * millisecond timestamps quick services are shared by how often they run instead
+    */
+    void setLevelShare(uint8_t level, uint8_t share);
+
+    /**
+    * Get the share of the processor time priority level gets
+    *
+    * @return: uint8_t share, 0 if it has none
+    */
+    uint8_t getLevelShare(uint8_t level);
+#endif
+
+// Enable this option in config.h to let processes with some slack share wakeups, see Process::setSlack()
+#ifdef _PROCESS_TIMER_SLACK
+    /**
+    * Get the number of times run() woke up because a process was due
+    *
+    * @return: uint32_t count
+    */
+    uint32_t getWakeupCount();
+
+    /**
+    * Get the number of processes that were taken along on another process' wakeup,
+    * inside their slack window, instead of waking up on their own
+    *
+    * @return: uint32_t count
+    */
+    uint32_t getWakeupsSaved();
+
+    /**
+    * Reset the wakeup counts back to zero
+    */
+    void resetWakeupStats();
+#endif
+
+    /**
+    * Get the most jobs that were ever waiting in the job queue at once
+    * Operations on a process that is already waiting in the queue are merged, and do not take another slot
+    * NOTE: If this gets close to SCHEDULER_JOB_QUEUE_SIZE, increase it in Config.h
+    *
+    * @return: uint8_t count
+    */
+    uint8_t getQueueHighWaterMark();
+
+    /**
+    * Get the number of operations that were dropped because the job queue was full
+    * ie. the number of times add(), enable(), etc... returned false
+    *
+    * @return: uint16_t count
+    */
+    uint16_t getDroppedOperations();
+
+    /**
+    * Reset the high water mark and dropped operations count back to zero
+    */
+    void resetQueueStats();
+
+// Enable this option in config.h to record what the scheduler does
+#ifdef _PROCESS_TRACE
+    /**
+    * Move the oldest trace records out of the trace buffer into records, at most max of them
+    * Dump them as is to a file or Serial.write(), then extras/TraceExport turns them into a timeline
+    * NOTE: Do not call this from a Process service routine, it might be missing the current dispatch
+    *
+    * @return: The number of records moved
+    */
+    uint16_t readTrace(TraceRecord *records, uint16_t max);
+
+    /**
+    * Get the number of records that were overwritten before they were read
+    * NOTE: If this is not zero, read more often or increase SCHEDULER_TRACE_SIZE in Config.h
+    *
+    * @return: uint16_t count
+    */
+    uint16_t getTraceLost();
+
+    /**
+    * Throw away every record, and reset the lost count back to zero
+    */
+    void resetTrace();
+#endif
+
 // Enable this option to allow processes to raise and catch custom exceptions
 // Behind the scenes this is using setjmp and longjmp
 #ifdef _PROCESS_EXCEPTION_HANDLING
@@ -193,6 +473,16 @@ protected:
     */
     virtual void handleException(Process *process, int e);
 #endif
+
+    /*
+    * Idle the processor for up to timeout, called by runOrSleep()
+    * It must return as soon as a job is queued, so force()d processes are not delayed
+    * Override this to use a different low power mode
+    */
+    virtual void idle(uint32_t timeout);
+
+    // idle() until the next process is due, counting the idle time, called by runOrSleep()
+    void idleUntilNextRun();
     // Inner queue object class to queue scheduler jobs
     class QueableOperation
     {
@@ -205,23 +495,56 @@ protected:
             DISABLE_SERVICE,
             ENABLE_SERVICE,
             RESTART_SERVICE,
+            RESCHEDULE_SERVICE,
+            PENDING_SERVICE, // Apply the pending operations stored in the process
             HALT,
-#ifdef _PROCESS_STATISTICS
-            UPDATE_STATS,
-#endif
+            GROUP_PENDING_SERVICE, // Apply the pending operations stored in the group to all of it
+        };
+
+        // Operations on a process waiting in the queue are folded into one byte, stored in the process
+        // Applied in order: the enable/disable before an add, the add/destroy/restart,
+        // the enable/disable after it, then the reschedule
+        enum PendingOperation
+        {
+            PENDING_LIFECYCLE_MASK = 0x07,
+            PENDING_ADD = 0x01,
+            PENDING_DESTROY = 0x02,
+            PENDING_DESTROY_ADD = 0x03,
+            PENDING_RESTART = 0x04,
+
+            PENDING_PRE_SHIFT = 3,
+            PENDING_POST_SHIFT = 5,
+            PENDING_ENABLE = 0x01, // Shifted by one of the shifts above
+            PENDING_DISABLE = 0x02,
+            PENDING_ENABLE_MASK = 0x03,
+
+            PENDING_RESCHEDULE = 0x80,
         };
 
         QueableOperation();
         QueableOperation(OperationType op);
         QueableOperation(Process *serv, OperationType op);
+        QueableOperation(ProcessGroup *group, OperationType op);
 
         Process *getProcess();
+        ProcessGroup *getGroup();
         OperationType getOperation();
-        bool queue(RingBuf *queue);
+
+        /*
+        * Fold op into a process' pending operations, so only the net change is kept
+        * ex: enable() -> disable() -> enable() is just an enable()
+        *
+        * @return: The new pending operations, never zero
+        */
+        static uint8_t merge(uint8_t pending, OperationType op);
 
     private:
-        Process *_process;
-        const uint8_t _operation;
+        union
+        {
+            Process *_process;
+            ProcessGroup *_group; // Only for GROUP_PENDING_SERVICE
+        };
+        uint8_t _operation;
     };
 
 
@@ -230,11 +553,18 @@ protected:
     bool jmpHandler(int e);
 #endif
 
+#ifdef _PROCESS_ADMISSION_CONTROL
+    // Check a process about to be enabled against the utilization bound, false if it should stay disabled
+    bool procAdmit(Process &process);
+    // Recount the utilization of a process that was enabled, disabled, or changed
+    void updateUtilization(Process &process);
+#endif
+
 #ifdef _PROCESS_STATISTICS
-    // Actually do the update that was requested in updateStats()
-    void procUpdateStats();
     // This will handle overflow condiitions on the statistics
     void handleHistOverFlow(uint8_t div);
+    // Count the time a run() that started at enter took, other than busy
+    void countOverhead(uint32_t enter, uint32_t busy);
 #endif
 
     // Methods that process queued operations
@@ -243,32 +573,182 @@ protected:
     void procDestroy(Process &process);
     void procAdd(Process &process);
     void procRestart(Process &process);
+    void procReschedule(Process &process);
+    void procPending(Process &process);
+    void procGroupPending(ProcessGroup &group);
     void procHalt();
 
-    // Get runnable process in process linked list chain
-    Process *getRunnable(uint32_t start, Process *begin, Process *end=NULL);
+    // Take the operations waiting in pending, leaving it zero
+    static uint8_t takePending(volatile uint8_t &pending);
+    // Apply pending operations ops to process, in the order described in QueableOperation
+    // job is the kind of job they came from, for the trace
+    void applyPending(Process &process, uint8_t ops, QueableOperation::OperationType job);
+
+    // Queue a job, keeping track of the queue stats
+    bool queueOperation(const QueableOperation &op);
+    // Queue an operation on a process, merging it with the ones already pending
+    bool queueOperation(Process &process, QueableOperation::OperationType op);
+    bool queueOperation(ProcessGroup &group, QueableOperation::OperationType op);
+    // Merge op into queuedOps, queueing job if nothing was pending yet
+    bool queuePending(volatile uint8_t &queuedOps, const QueableOperation &job, QueableOperation::OperationType op);
+    // Count a job that did not fit in the queue
+    void dropOperation();
+
+    // Queue a process to have its place in the heaps updated
+    // Called when its period, iterations, timestamps, or force flag changed
+    bool reschedule(Process &process);
+
+    // The body of runFor() for a scheduling policy, defined in Policy.h
+    // run() is a budget of 0, which stops after the first process
+    template <class Policy>
+    int runPolicy(uint32_t budget = 0);
+
+    // Move every due process from the sleep heap to the ready heap the policy picks, defined in Policy.h
+    template <class Policy>
+    void releaseDue(uint32_t now);
+
+#ifdef _PROCESS_TIMER_SLACK
+    // Already awake, so also release every sleeping process whose slack window has started
+    template <class Policy>
+    void releaseSlack(uint32_t now);
+#endif
+
+    // When process is due next, not counting its slack
+    static uint32_t dueTS(Process &process);
+
+    // Pop the process that should be serviced next, NULL if none is ready
+    Process *popReady(uint32_t now);
+
+    // The level to pop the next process from, NUM_PRIORITY_LEVELS if none is ready
+    uint8_t nextLevel();
+
+#ifdef _PROCESS_AGING
+    // Keep track of how long each level waited, and pick a starved level over pick, if any
+    uint8_t agedLevel(uint8_t pick, uint32_t now);
+    // Has level gone without a turn for too long
+    bool isStarved(uint8_t level, uint32_t now);
+#endif
+
+#ifdef _PROCESS_FAIR_SHARE
+    // The highest level with something ready that has budget left, deficit round robin
+    uint8_t fairShareLevel();
+#endif
+
+    // Service a process popped from a ready heap, then put it back in line
+    void dispatch(Process &process);
+
+    // Put an enabled process in the sleep heap until it is due, only if it can run
+    void schedule(Process &process);
 
     // Process the scheduler job queue
     void processQueue();
+    // Reschedule every forced process that is not in line to run yet
+    void procForceLost();
+
+#ifdef _PROCESS_TRACE
+    // Add a record to the trace buffer, overwriting the oldest one if it is full
+    void trace(TraceEvent event, uint8_t id, uint16_t arg = 0);
+#endif
 
     // Linked list methods
     bool appendNode(Process &node); // true on success
     bool removeNode(Process &node); // true on success
-    bool findNode(Process &node); // True if node exists in list
-    Process *findPrevNode(Process &node);
+
+    // Heap methods, enabled processes wait in the sleep heap until they are due,
+    // then in a ready heap until they are serviced. These are all pairing heaps,
+    // or with _PROCESS_LINEAR_SCAN just the cached first one, found by scanning _procTable
+    void heapPush(Process &node, uint8_t heap, uint32_t key);
+    void heapRemove(Process &node);
+    Process *heapPop(uint8_t heap);
+    Process *&heapRoot(uint8_t heap);
+    static bool heapBefore(Process *p1, Process *p2);
+#ifdef _PROCESS_LINEAR_SCAN
+    Process *heapScan(uint8_t heap);
+#else
+    static Process *heapMerge(Process *p1, Process *p2);
+    static Process *heapMergePairs(Process *first);
+#endif
 
 
     static Process *_active; // needs to be static for access in ISR
-    uint8_t _lastID;
-    RingBuf *_queue;
+#ifdef _PROCESS_COMPACT
+    static Scheduler *_instance; // The only one, processes find it here instead of keeping a reference
+#endif
+#ifdef _PROCESS_CUSTOM_CLOCK
+    static ProcessClock *_clock; // static like getCurrTS()
+#endif
+    uint16_t _heapSeq;
+    Process *_sleepHeap;
+    JobQueue<QueableOperation, SCHEDULER_JOB_QUEUE_SIZE> _queue;
+    volatile uint8_t _queueHighWater;
+    volatile uint16_t _queueDropped;
+    // A force() could not queue its reschedule, see procForceLost()
+    volatile bool _forceLost;
+
+#ifdef _PROCESS_STATISTICS
+    // Time spent in service() across every process, in idle(), and the rest of run()
+    LoadAverage _load, _idleLoad, _overheadLoad;
+    sTimeCount_t _busyTime, _idleTime, _overheadTime;
+#endif
+
+#ifdef _PROCESS_TRACE
+    TraceRecord _trace[SCHEDULER_TRACE_SIZE];
+    uint16_t _traceHead, _traceCount;
+    uint16_t _traceLost;
+#endif
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+    uint16_t _utilBound;
+    AdmissionMode _admissionMode;
+    // Enabled processes with a utilization above zero
+    uint8_t _utilCount;
+#endif
+
+#ifdef _PROCESS_AGING
+    uint32_t _agingWait;
+    uint16_t _agingPassed;
+#endif
+
+#ifdef _PROCESS_TIMER_SLACK
+    uint16_t _maxSlack; // The most slack any process was given
+    uint32_t _wakeups, _wakeupsSaved;
+#endif
+
+#ifdef _PROCESS_FAIR_SHARE
+    bool _fairShare; // Some level has a share
+    uint8_t _chargeLevel; // The level the process being serviced was popped from
+#endif
 
     struct SchedulerPriorityLevel
     {
+#ifndef _PROCESS_COMPACT
         Process *head;
-        Process *next;
+        Process *tail;
+#endif
+        Process *heap; // Root of the ready heap
+#ifdef _PROCESS_ADMISSION_CONTROL
+        uint16_t util; // Utilization of the enabled processes
+#endif
+#ifdef _PROCESS_FAIR_SHARE
+        uint8_t share;
+        int32_t deficit; // Time left this round, below zero if it went over
+#endif
+#ifdef _PROCESS_AGING
+        bool waiting; // Something is ready
+        uint32_t waitingSince; // When something got ready, or it last had a turn
+        uint16_t passed; // Times a higher level went first since then
+        uint16_t boosts;
+        uint32_t longestWait;
+#endif
     };
     struct SchedulerPriorityLevel _pLevels[NUM_PRIORITY_LEVELS];
 
+    // Added processes indexed by id-1, a process is added iff its slot points to it
+    Process *_procTable[SCHEDULER_MAX_PROCESSES];
+    // Ring of free ids, the least recently freed id gets reused first
+    uint8_t _freeIDs[SCHEDULER_MAX_PROCESSES];
+    uint8_t _freeHead, _freeCount;
+
 
 /* CUSTOM COMPILE OPTIONS*/
 /*
@@ -0,0 +1,68 @@
+#include "StackfulProcess.h"
+
+#ifdef _PROCESS_STACKFUL
+
+void *StackfulProcess::_schedulerSp = NULL;
+
+    /*********** PUBLIC *************/
+    StackfulProcess::StackfulProcess(Scheduler &manager, ProcPriority priority, uint32_t period,
+            uint8_t *stack, uint16_t stackSize, int iterations, uint16_t overSchedThresh)
+    : Process(manager, priority, period, iterations, overSchedThresh),
+    _stack(stack), _stackSize(stackSize), _sp(NULL)
+    {
+        memset(_stack, STACK_FILL_PATTERN, _stackSize);
+    }
+
+    uint16_t StackfulProcess::getStackHighWaterMark()
+    {
+        // The stack grows down, so the bottom is the last to be touched
+        uint16_t untouched = 0;
+        while (untouched < _stackSize && _stack[untouched] == STACK_FILL_PATTERN)
+            untouched++;
+
+        return _stackSize - untouched;
+    }
+
+    /*********** PROTECTED *************/
+    void StackfulProcess::yield()
+    {
+        suspend(Scheduler::getCurrTS());
+    }
+
+    void StackfulProcess::sleepFor(uint32_t time)
+    {
+        suspend(Scheduler::getCurrTS() + time);
+    }
+
+    void StackfulProcess::service()
+    {
+        // Only set again if it suspends, so a stale stack is never resumed after an exception
+        bool resume = _resume != RESUME_NONE;
+        _resume = RESUME_NONE;
+
+        if (!resume)
+            _sp = processContextInit(_stack, _stackSize, entry);
+
+        processContextSwitch(&_schedulerSp, _sp);
+    }
+
+    /*********** PRIVATE *************/
+    void StackfulProcess::suspend(uint32_t ts)
+    {
+        _resumeTS = ts;
+        _resume = RESUME_AT_TS;
+        processContextSwitch(&_sp, _schedulerSp);
+    }
+
+    void StackfulProcess::entry()
+    {
+        StackfulProcess *self = static_cast<StackfulProcess *>(Scheduler::getActive());
+        self->task();
+
+        // Done with this iteration, the next one starts on a fresh stack
+        self->_resume = RESUME_NONE;
+        processContextSwitch(&self->_sp, _schedulerSp);
+        for (;;); // Never switched back to
+    }
+
+#endif
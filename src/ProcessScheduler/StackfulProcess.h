@@ -0,0 +1,99 @@
+#ifndef STACKFUL_PROCESS_H
+#define STACKFUL_PROCESS_H
+
+#include "Includes.h"
+#include "Process.h"
+
+#ifdef _PROCESS_STACKFUL
+
+#include "Context.h"
+
+// Unused stack is filled with this, to find the high water mark
+#define STACK_FILL_PATTERN 0xA5
+
+/*
+* A Process with its own stack, override task() instead of service()
+* task() can give up the processor with yield(), sleepFor(), or waitUntil(), and
+* the next time it is serviced it picks up right where it left off
+* One iteration is one whole run of task(), the period is from the start of one to the next
+*/
+class StackfulProcess : public Process
+{
+public:
+    /*
+    * @param stack: The memory for this Process' stack, it has to last as long as the Process
+    * @param stackSize: The size of stack in bytes, leave room for interrupts (they run on it too)
+    * (see Process for the rest)
+    */
+    StackfulProcess(Scheduler &manager, ProcPriority priority, uint32_t period,
+            uint8_t *stack, uint16_t stackSize,
+            int iterations=RUNTIME_FOREVER,
+            uint16_t overSchedThresh = OVERSCHEDULED_NO_WARNING);
+
+    /*
+    * Get the most stack this Process has ever used
+    * NOTE: If this is the same as getStackSize(), it probably overflowed
+    *
+    * @return: uint16_t bytes
+    */
+    uint16_t getStackHighWaterMark();
+
+    /*
+    * Get the size of this Process' stack
+    *
+    * @return: uint16_t bytes
+    */
+    inline uint16_t getStackSize() { return _stackSize; }
+
+    /*
+    * Determine if task() is in the middle of an iteration (yielded, sleeping, or waiting)
+    * NOTE: Destroying or restarting the Process drops that iteration, nothing on its stack is destructed
+    *
+    * @return: bool
+    */
+    inline bool isSuspended() { return _resume != RESUME_NONE; }
+
+protected:
+    /*
+    * This is where your Process' routine goes, instead of service()
+    */
+    virtual void task() = 0;
+
+    /*
+    * Give up the processor, task() resumes once the other ready processes had their turn
+    * NOTE: ONLY CALL THIS FROM WITHIN task()
+    */
+    void yield();
+
+    /*
+    * Give up the processor for at least time (same units as the period)
+    * NOTE: ONLY CALL THIS FROM WITHIN task()
+    */
+    void sleepFor(uint32_t time);
+
+    /*
+    * Keep yielding until pred() returns true
+    * pred can be a function or a lambda
+    * NOTE: ONLY CALL THIS FROM WITHIN task()
+    */
+    template <typename Pred>
+    void waitUntil(Pred pred) { while (!pred()) yield(); }
+
+    // Switches to task(), do not override
+    virtual void service();
+
+private:
+    // Switch back to the scheduler, task() resumes at ts
+    void suspend(uint32_t ts);
+    // Where a fresh stack starts out
+    static void entry();
+
+    uint8_t *_stack;
+    uint16_t _stackSize;
+    void *_sp; // Stack pointer while suspended
+    static void *_schedulerSp; // Stack pointer of the scheduler while a task() runs
+};
+
+#endif
+
+#endif
@@ -0,0 +1,483 @@
+#ifndef STATIC_SCHEDULER_H
+#define STATIC_SCHEDULER_H
+
+#include "Includes.h"
+#include "Scheduler.h"
+
+/*
+* A scheduler for a set of processes that is fixed at compile time
+*
+* Each process is its own class deriving from StaticProcess<itself>, and the scheduler holds
+* one of each. There are no virtual methods, service() and the hooks are called directly so they
+* can be inlined, and nothing is allocated at run time. The scheduling state of every process
+* sits together in one array, which run() scans for the next one due:
+*   struct Blink : StaticProcess<Blink> {
+*       static const uint32_t PERIOD = 500;
+*       void service() { digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN)); }
+*   };
+*   StaticScheduler<Blink, Logger> sched;
+*   sched.begin(); // setup() and enable() everything
+*   sched.run(); // In loop()
+*   sched.get<Logger>().disable();
+*
+* Processes are serviced like Scheduler does by default, forced processes first, then strict
+* priority levels, then whichever is most behind. run() looks at every process, which beats the
+* heaps for the few dozen processes a sketch has, see bench/StaticBench.cpp
+* NOTE: None of the Config.h options apply (statistics, exceptions, timeouts, tracing, ...),
+* use Scheduler for those
+*/
+
+
+// Everything StaticScheduler keeps on a process, in one array
+struct StaticProcessState
+{
+    uint32_t scheduledTS;
+    uint32_t period;
+    int iterations;
+    uint16_t pBehind;
+    uint8_t priority;
+    bool enabled;
+    volatile bool force;
+};
+
+template <class... Procs>
+class StaticScheduler;
+
+
+/*
+* The base class of a process run by StaticScheduler, Derived is the class deriving from it
+* Hide any of these in Derived to change them:
+*   static const ProcPriority PRIORITY; // The priority of this process defined in config.h
+*   static const uint32_t PERIOD; // The period it should be serviced at, ex: SERVICE_CONSTANTLY
+*   static const int ITERATIONS; // Number of iterations before being disabled, ex: RUNTIME_FOREVER
+*   static const uint16_t OVERSCHED_THRESH; // See Process
+* And write any of the hooks, service() is the only one you have to. They are called from the
+* scheduler, so they have to be public. See Process for what each of them is for
+* NOTE: A Derived has to be default constructible, the scheduler constructs it
+*/
+template <class Derived>
+class StaticProcess
+{
+    template <class... Procs>
+    friend class StaticScheduler;
+public:
+    static const ProcPriority PRIORITY = MEDIUM_PRIORITY;
+    static const uint32_t PERIOD = SERVICE_CONSTANTLY;
+    static const int ITERATIONS = RUNTIME_FOREVER;
+    static const uint16_t OVERSCHED_THRESH = OVERSCHEDULED_NO_WARNING;
+
+    StaticProcess() : _state(NULL) {}
+
+    ///////////////////// PROCESS OPERATIONS /////////////////////////
+    // Unlike Process these take effect right away, so do not call them from an interrupt (except force())
+
+    /*
+    * Enable this process, it is first serviced one period from now
+    * If it is already enabled, do nothing
+    * This will trigger onEnable()
+    */
+    void enable()
+    {
+        if (_state->enabled)
+            return;
+
+        resetTimeStamps();
+        self().onEnable();
+        _state->enabled = true;
+    }
+
+    /*
+    * Disable this process
+    * If it is already disabled, do nothing
+    * This will trigger onDisable()
+    */
+    void disable()
+    {
+        if (!_state->enabled)
+            return;
+
+        self().onDisable();
+        _state->enabled = false;
+    }
+
+    /*
+    * Have it serviced on the next run(), even if it is not due
+    * This does not count as an iteration
+    * NOTE: Safe to call from an interrupt
+    */
+    inline void force() { _state->force = true; }
+
+    ///////////////////// GETTERS /////////////////////////
+    inline bool isEnabled() { return _state->enabled; }
+    inline uint8_t getPriority() { return _state->priority; }
+    inline uint32_t getPeriod() { return _state->period; }
+    inline int getIterations() { return _state->iterations; }
+    inline uint32_t getScheduledTS() { return _state->scheduledTS; }
+    inline uint16_t getCurrPBehind() { return _state->pBehind; }
+    inline int32_t timeToNextRun() { return (int32_t)((_state->scheduledTS + _state->period) - Scheduler::getCurrTS()); }
+
+    ///////////////////// SETTERS /////////////////////////
+    inline void setPeriod(uint32_t period) { _state->period = period; }
+    inline void setIterations(int iterations) { _state->iterations = iterations; }
+    inline void resetOverSchedWarning() { _state->pBehind = 0; }
+
+    /*
+    * Forget how far behind this process is, it is next due one period from now
+    */
+    void resetTimeStamps()
+    {
+        _state->scheduledTS = Scheduler::getCurrTS();
+        _state->pBehind = 0;
+    }
+
+    ///////////////////// HOOKS /////////////////////////
+    // Defaults for the ones Derived does not write, service() has none
+    void setup() {}
+    void cleanup() {}
+    void onEnable() {}
+    void onDisable() {}
+    void handleWarning(ProcessWarning warning)
+    {
+        if (warning == WARNING_PROC_OVERSCHEDULED)
+            resetOverSchedWarning();
+    }
+
+private:
+    inline Derived &self() { return *static_cast<Derived *>(this); }
+
+    StaticProcessState *_state;
+};
+
+
+// Holds one of each process, each level derives from the rest of the list
+template <class... Procs>
+struct StaticProcessList
+{
+    template <class F>
+    inline void visit(uint8_t, F &) {}
+
+    template <class F>
+    inline void forEach(F &) {}
+};
+
+template <class Head, class... Tail>
+struct StaticProcessList<Head, Tail...> : StaticProcessList<Tail...>
+{
+    Head head;
+
+    // Call f on process i, the compiler turns this into a chain of direct calls
+    template <class F>
+    inline void visit(uint8_t i, F &f)
+    {
+        if (!i)
+            f(head);
+        else
+            StaticProcessList<Tail...>::visit(i - 1, f);
+    }
+
+    template <class F>
+    inline void forEach(F &f)
+    {
+        f(head);
+        StaticProcessList<Tail...>::forEach(f);
+    }
+};
+
+// The type of process I in Procs, and where it is in a StaticProcessList
+template <uint8_t I, class... Procs>
+struct StaticProcessAt;
+
+template <class Head, class... Tail>
+struct StaticProcessAt<0, Head, Tail...>
+{
+    typedef Head type;
+    static inline type &get(StaticProcessList<Head, Tail...> &list) { return list.head; }
+};
+
+template <uint8_t I, class Head, class... Tail>
+struct StaticProcessAt<I, Head, Tail...>
+{
+    typedef typename StaticProcessAt<I - 1, Tail...>::type type;
+    static inline type &get(StaticProcessList<Head, Tail...> &list) { return StaticProcessAt<I - 1, Tail...>::get(list); }
+};
+
+// The index of the first P in Procs, sizeof...(Procs) if there is none
+template <class P, class... Procs>
+struct StaticProcessIndex
+{
+    static const uint8_t value = 0;
+};
+
+template <class P, class Head, class... Tail>
+struct StaticProcessIndex<P, Head, Tail...>
+{
+    static const uint8_t value = StaticProcessIndex<P, Tail...>::value + 1;
+};
+
+template <class P, class... Tail>
+struct StaticProcessIndex<P, P, Tail...>
+{
+    static const uint8_t value = 0;
+};
+
+
+/*
+* The scheduler for a fixed set of processes, Procs are the classes of the processes
+* The same class can be in there more than once, use get<I>() to tell them apart
+*/
+template <class... Procs>
+class StaticScheduler
+{
+public:
+    static const uint8_t COUNT = sizeof...(Procs);
+
+    StaticScheduler() : _state{}, _active(NO_ACTIVE), _last(COUNT - 1)
+    {
+        // Hand each process its state, with its defaults
+        Bind bind = { _state };
+        _procs.forEach(bind);
+    }
+
+    /*
+    * Call every process' setup(), and enable them unless enableAll is false
+    * Call this once in your void setup()
+    */
+    void begin(bool enableAll = true)
+    {
+        Setup setup = { enableAll };
+        _procs.forEach(setup);
+    }
+
+    /*
+    * Disable every process and call its cleanup()
+    */
+    void end()
+    {
+        Cleanup cleanup;
+        _procs.forEach(cleanup);
+    }
+
+    /*
+    * Get process I, in the order of Procs
+    *
+    * @return: Reference to the process
+    */
+    template <uint8_t I>
+    inline typename StaticProcessAt<I, Procs...>::type &get()
+    {
+        static_assert(I < COUNT, "StaticScheduler has no process at that index");
+        return StaticProcessAt<I, Procs...>::get(_procs);
+    }
+
+    /*
+    * Get the (first) process of class P
+    *
+    * @return: Reference to the process
+    */
+    template <class P>
+    inline P &get()
+    {
+        static_assert(StaticProcessIndex<P, Procs...>::value < COUNT, "StaticScheduler has no process of that class");
+        return get<StaticProcessIndex<P, Procs...>::value>();
+    }
+
+    /*
+    * Run one pass through the scheduler, call this repeatedly in your void loop()
+    *
+    * @return: The number of processes serviced in that pass
+    */
+    int run()
+    {
+        // Already running in another call frame
+        if (_active != NO_ACTIVE)
+            return 0;
+
+        uint32_t now = Scheduler::getCurrTS();
+
+        // Start after the last one serviced, so ties take turns
+        uint8_t next = NO_ACTIVE;
+        uint8_t i = _last;
+        for (uint8_t n = 0; n < COUNT; n++)
+        {
+            i = i + 1 < COUNT ? i + 1 : 0;
+            if (isReady(_state[i], now) && (next == NO_ACTIVE || runsBefore(_state[i], _state[next])))
+                next = i;
+        }
+
+        if (next == NO_ACTIVE)
+            return 0;
+
+        _last = next;
+        dispatch(next, now);
+        return 1;
+    }
+
+    /*
+    * Get the time until the next process needs to be serviced
+    *
+    * @return: uint32_t time, 0 if something is due, NEXT_RUN_NEVER if nothing is scheduled
+    */
+    uint32_t timeUntilNextRun()
+    {
+        uint32_t now = Scheduler::getCurrTS();
+        uint32_t soonest = NEXT_RUN_NEVER;
+
+        for (uint8_t i = 0; i < COUNT; i++)
+        {
+            StaticProcessState &s = _state[i];
+            if (isReady(s, now))
+                return 0;
+            if (!s.enabled || !s.iterations || s.period == SERVICE_ON_EVENT)
+                continue;
+
+            uint32_t ttnr = s.scheduledTS + s.period - now;
+            if (ttnr < soonest)
+                soonest = ttnr;
+        }
+
+        return soonest;
+    }
+
+    /*
+    * Get the number of processes, if enabledOnly = true only the enabled ones
+    *
+    * @return: uint8_t count
+    */
+    uint8_t countProcesses(bool enabledOnly = true)
+    {
+        uint8_t count = 0;
+        for (uint8_t i = 0; i < COUNT; i++)
+            count += !enabledOnly || _state[i].enabled;
+        return count;
+    }
+
+    /*
+    * Get the index of the process being serviced
+    *
+    * @return: The index in Procs, COUNT if none is
+    */
+    inline uint8_t getActive() { return _active == NO_ACTIVE ? COUNT : _active; }
+
+    static inline uint32_t getCurrTS() { return Scheduler::getCurrTS(); }
+
+private:
+    static_assert(sizeof...(Procs) > 0 && sizeof...(Procs) < 255, "StaticScheduler needs 1 to 254 processes");
+
+    static const uint8_t NO_ACTIVE = 0xFF;
+
+    static bool isReady(StaticProcessState &s, uint32_t now)
+    {
+        if (!s.enabled)
+            return false;
+        if (s.force)
+            return true;
+        if (!s.iterations || s.period == SERVICE_ON_EVENT)
+            return false;
+        return s.period == SERVICE_CONSTANTLY || (int32_t)(s.scheduledTS + s.period - now) <= 0;
+    }
+
+    // Same order as FixedPriorityPolicy
+    static bool runsBefore(StaticProcessState &s1, StaticProcessState &s2)
+    {
+        if (s1.force != s2.force)
+            return s1.force;
+        if (s1.priority != s2.priority)
+            return s1.priority < s2.priority;
+        return (int32_t)((s1.scheduledTS + s1.period) - (s2.scheduledTS + s2.period)) < 0;
+    }
+
+    void dispatch(uint8_t i, uint32_t now)
+    {
+        StaticProcessState &s = _state[i];
+        bool force = s.force;
+
+        if (!force)
+            s.scheduledTS = s.period == SERVICE_CONSTANTLY ? now : s.scheduledTS + s.period;
+        else
+            s.force = false;
+
+        _active = i;
+        Service service = { now };
+        _procs.visit(i, service);
+        _active = NO_ACTIVE;
+
+        // Is it time to disable?
+        if (!force && s.iterations > 0 && !--s.iterations) {
+            Disable disable;
+            _procs.visit(i, disable);
+        }
+    }
+
+    // The functors handed to StaticProcessList, one call for each process class
+    struct Bind
+    {
+        StaticProcessState *next;
+
+        template <class P>
+        void operator()(P &p)
+        {
+            p._state = next++;
+            p._state->priority = P::PRIORITY;
+            p._state->period = P::PERIOD;
+            p._state->iterations = P::ITERATIONS;
+        }
+    };
+
+    struct Setup
+    {
+        bool enable;
+
+        template <class P>
+        void operator()(P &p)
+        {
+            p.setup();
+            if (enable)
+                p.enable();
+        }
+    };
+
+    struct Cleanup
+    {
+        template <class P>
+        void operator()(P &p)
+        {
+            p.disable();
+            p.cleanup();
+        }
+    };
+
+    struct Disable
+    {
+        template <class P>
+        void operator()(P &p) { p.disable(); }
+    };
+
+    struct Service
+    {
+        uint32_t now;
+
+        template <class P>
+        void operator()(P &p)
+        {
+            // Handle scheduler warning, same as Process. Compiled out without a threshold
+            if (P::OVERSCHED_THRESH != OVERSCHEDULED_NO_WARNING) {
+                StaticProcessState &s = *p._state;
+                if (now - s.scheduledTS >= s.period) {
+                    if (++s.pBehind >= P::OVERSCHED_THRESH)
+                        p.handleWarning(WARNING_PROC_OVERSCHEDULED);
+                } else {
+                    s.pBehind = 0;
+                }
+            }
+
+            p.service();
+        }
+    };
+
+    StaticProcessState _state[COUNT];
+    StaticProcessList<Procs...> _procs;
+    uint8_t _active;
+    uint8_t _last; // The last one serviced
+};
+
+#endif
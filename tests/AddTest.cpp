@@ -0,0 +1,84 @@
+/*
+* AddTest.cpp
+* add() only adds, the process stays disabled until it is enabled
+* Also built with _PROCESS_ADMISSION_CONTROL, where only enabling it is checked for schedulability
+*/
+
+#include <ProcessScheduler.h>
+#include "Check.h"
+
+class CountProcess : public Process
+{
+public:
+    CountProcess(Scheduler &manager)
+        :  Process(manager, HIGH_PRIORITY, SERVICE_CONSTANTLY) {}
+
+    int services = 0;
+    int setups = 0;
+    int unschedulable = 0;
+
+protected:
+    virtual void setup() { setups++; }
+    virtual void service() { services++; }
+#ifdef _PROCESS_ADMISSION_CONTROL
+    virtual void handleWarning(ProcessWarning warning)
+    {
+        if (warning == WARNING_PROC_UNSCHEDULABLE)
+            unschedulable++;
+    }
+#endif
+};
+
+int main()
+{
+    Scheduler sched;
+    CountProcess proc(sched);
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+    // Needs the whole processor, but only half of it is allowed
+    sched.setAdmissionMode(ADMISSION_REFUSE);
+    sched.setUtilizationBound(UTILIZATION_ONE / 2);
+    proc.setPeriod(10);
+    proc.setWorstCaseRunTime(20);
+#endif
+
+    CHECK(proc.add());
+    for (int i = 0; i < 5; i++)
+        sched.run();
+
+    CHECK(proc.isNotDestroyed());
+    CHECK(!proc.isEnabled());
+    CHECK(proc.setups == 1);
+    CHECK(proc.services == 0);
+    CHECK(sched.countProcesses(ALL_PRIORITY_LEVELS, false) == 1);
+    CHECK(sched.countProcesses(ALL_PRIORITY_LEVELS, true) == 0);
+
+#ifdef _PROCESS_ADMISSION_CONTROL
+    CHECK(proc.unschedulable == 0);
+
+    // Refused once it is enabled
+    proc.enable();
+    sched.run();
+    CHECK(proc.unschedulable == 1);
+    CHECK(!proc.isEnabled());
+#else
+    proc.enable();
+    for (int i = 0; i < 5; i++)
+        sched.run();
+    CHECK(proc.isEnabled());
+    CHECK(proc.services > 0);
+
+    // add(true) still enables it
+    CountProcess other(sched);
+    CHECK(other.add(true));
+    sched.run();
+    CHECK(other.isEnabled());
+    other.destroy();
+#endif
+
+    proc.destroy();
+    sched.run();
+    CHECK(!proc.isNotDestroyed());
+
+    return CHECK_RESULT();
+}
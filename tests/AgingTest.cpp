@@ -0,0 +1,74 @@
+/*
+* AgingTest.cpp
+* runUntilIdle() has to age the lower levels by the time that went by during the pass,
+* not by the time it started, or a long pass never boosts anything
+*/
+
+#include <ProcessScheduler.h>
+#include "Check.h"
+
+#define HIGH_COUNT 5
+#define RUN_TIME 10
+
+static int order = 0;
+
+class OrderProcess : public Process
+{
+public:
+    OrderProcess(Scheduler &manager, ProcPriority pr)
+        :  Process(manager, pr, SERVICE_CONSTANTLY) {}
+
+    int servedAt = -1;
+
+protected:
+    virtual void service()
+    {
+        if (servedAt < 0)
+            servedAt = order++;
+    }
+};
+
+static VirtualClock clock(1000);
+static Scheduler sched;
+
+class HighProcess : public OrderProcess
+{
+public:
+    HighProcess() :  OrderProcess(sched, HIGH_PRIORITY) {}
+};
+
+static uint32_t runTime(Process &)
+{
+    return RUN_TIME;
+}
+
+int main()
+{
+    clock.setRunTimeModel(runTime);
+    Scheduler::setClock(&clock);
+    // Boost a level that waited for more than two services
+    sched.setAging(RUN_TIME * 2 + RUN_TIME / 2, AGING_OFF);
+
+    static HighProcess highs[HIGH_COUNT];
+    for (int i = 0; i < HIGH_COUNT; i++)
+        highs[i].add(true);
+    OrderProcess low(sched, LOW_PRIORITY);
+    low.add(true);
+    sched.run(); // Add them
+    clock.advance(1);
+
+    // One pass, everything was released at the start of it
+    CHECK(sched.runUntilIdle() == HIGH_COUNT + 1);
+
+    CHECK(low.servedAt >= 0);
+    CHECK(low.servedAt < HIGH_COUNT);
+    CHECK(sched.getStarvationCount(LOW_PRIORITY) == 1);
+
+    for (int i = 0; i < HIGH_COUNT; i++)
+        highs[i].destroy();
+    low.destroy();
+    sched.run();
+    Scheduler::setClock(NULL);
+
+    return CHECK_RESULT();
+}
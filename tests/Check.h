@@ -0,0 +1,24 @@
+/*
+* Check.h
+* Just enough for the host tests, each test is its own executable run by ctest
+*/
+
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+// Report a failed condition, and keep going
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        checkFailures++; \
+    } \
+} while (0)
+
+// Return this from main()
+#define CHECK_RESULT() (printf(checkFailures ? "FAILED (%d)\n" : "PASSED\n", checkFailures), checkFailures != 0)
+
+#endif
@@ -0,0 +1,153 @@
+/*
+* CoProcessTest.cpp
+* CoProcess: co_await sleep() waits on the clock, co_await on a ProcessEvent waits
+* for set(), frames come from the pool and go back to it, and a task() too big
+* for a frame raises WARNING_PROC_NO_FRAME
+*/
+
+#include <ProcessScheduler.h>
+#include <string.h>
+#include "Check.h"
+
+static char steps[64];
+static ProcessEvent event;
+
+static void step(char c)
+{
+    size_t len = strlen(steps);
+    if (len + 1 < sizeof(steps)) {
+        steps[len] = c;
+        steps[len + 1] = 0;
+    }
+}
+
+// Runs once: first, sleep(100), second, waits for the event, third
+class StepProcess : public CoProcess
+{
+public:
+    StepProcess(Scheduler &manager, const char *names)
+        :  CoProcess(manager, HIGH_PRIORITY, SERVICE_CONSTANTLY, 1),
+        _names(names) {}
+
+protected:
+    virtual Task task()
+    {
+        step(_names[0]);
+        co_await scheduler().sleep(100);
+        step(_names[1]);
+        co_await event;
+        step(_names[2]);
+    }
+
+private:
+    const char *_names;
+};
+
+// Its frame will not fit in COROUTINE_FRAME_SIZE
+class BigProcess : public CoProcess
+{
+public:
+    BigProcess(Scheduler &manager)
+        :  CoProcess(manager, HIGH_PRIORITY, SERVICE_CONSTANTLY, 1) {}
+
+    uint8_t noFrame = 0;
+
+protected:
+    virtual Task task()
+    {
+        volatile uint8_t buf[COROUTINE_FRAME_SIZE * 2];
+        buf[0] = 1;
+        co_await scheduler().sleep(0);
+        buf[1] = buf[0];
+    }
+
+    virtual void handleWarning(ProcessWarning warning)
+    {
+        if (warning == WARNING_PROC_NO_FRAME)
+            noFrame++;
+    }
+};
+
+static void runFor(Scheduler &sched, VirtualClock &clock, uint32_t time)
+{
+    for (uint32_t i = 0; i < time; i++)
+    {
+        sched.run();
+        clock.advance(1);
+    }
+}
+
+int main()
+{
+    VirtualClock clock;
+    Scheduler::setClock(&clock);
+    Scheduler sched;
+
+    StepProcess a(sched, "ABC"), b(sched, "abc");
+    a.add(true);
+    b.add(true);
+    sched.run(); // Add them
+
+    runFor(sched, clock, 10);
+    CHECK(!strcmp(steps, "Aa"));
+    CHECK(a.isSuspended());
+    CHECK(b.isSuspended());
+    CHECK(CoProcess::getFramesInUse() == 2);
+
+    // Both wake up, then wait for the event
+    runFor(sched, clock, 100);
+    CHECK(!strcmp(steps, "AaBb"));
+    runFor(sched, clock, 100);
+    CHECK(!strcmp(steps, "AaBb"));
+    CHECK(a.isSuspended());
+
+    event.set();
+    runFor(sched, clock, 10);
+    // Both wake up, in no particular order
+    CHECK(!strcmp(steps, "AaBbCc") || !strcmp(steps, "AaBbcC"));
+    CHECK(!a.isSuspended());
+    CHECK(a.getIterations() == 0);
+    CHECK(CoProcess::getFramesInUse() == 0);
+    CHECK(CoProcess::getLargestFrame() > 0);
+    CHECK(CoProcess::getLargestFrame() <= COROUTINE_FRAME_SIZE);
+
+    // Already set, so it does not wait; destroying it while asleep gives back its frame
+    steps[0] = 0;
+    a.setIterations(1);
+    a.restart();
+    runFor(sched, clock, 10);
+    CHECK(!strcmp(steps, "A"));
+    CHECK(CoProcess::getFramesInUse() == 1);
+    a.destroy();
+    runFor(sched, clock, 200);
+    CHECK(!strcmp(steps, "A"));
+    CHECK(!a.isSuspended());
+    CHECK(CoProcess::getFramesInUse() == 0);
+
+    // Dropped while waiting, set() later must not touch it
+    event.clear();
+    steps[0] = 0;
+    b.setIterations(1);
+    b.restart();
+    runFor(sched, clock, 110);
+    CHECK(!strcmp(steps, "ab"));
+    b.destroy();
+    sched.run();
+    event.set();
+    runFor(sched, clock, 10);
+    CHECK(!strcmp(steps, "ab"));
+    CHECK(CoProcess::getFramesInUse() == 0);
+
+    BigProcess big(sched);
+    big.add(true);
+    runFor(sched, clock, 5);
+    CHECK(big.noFrame > 0);
+    CHECK(CoProcess::getFramesInUse() == 0);
+    CHECK(CoProcess::getLargestFrame() > COROUTINE_FRAME_SIZE);
+
+    big.destroy();
+    sched.run();
+    Scheduler::setClock(NULL);
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,56 @@
+/*
+* FairShareTest.cpp
+* With millisecond timestamps nearly every service() takes "0 ms", the configured
+* shares still have to split the dispatches between the busy levels
+*/
+
+#include <ProcessScheduler.h>
+#include "Check.h"
+
+#define DISPATCHES 10000
+
+class CountProcess : public Process
+{
+public:
+    CountProcess(Scheduler &manager, ProcPriority pr)
+        :  Process(manager, pr, SERVICE_CONSTANTLY) {}
+
+    uint32_t services = 0;
+
+protected:
+    virtual void service() { services++; }
+};
+
+int main()
+{
+    Scheduler sched;
+    CountProcess high(sched, HIGH_PRIORITY), medium(sched, MEDIUM_PRIORITY), low(sched, LOW_PRIORITY);
+    high.add(true);
+    medium.add(true);
+    low.add(true);
+    sched.run(); // Add them
+
+    sched.setLevelShare(HIGH_PRIORITY, 70);
+    sched.setLevelShare(MEDIUM_PRIORITY, 20);
+    sched.setLevelShare(LOW_PRIORITY, 10);
+
+    high.services = medium.services = low.services = 0;
+    for (uint32_t i = 0; i < DISPATCHES; i++)
+        sched.run();
+
+    uint32_t total = high.services + medium.services + low.services;
+    CHECK(total == DISPATCHES);
+    // Within a few percent of 70/20/10
+    CHECK(high.services > total * 65 / 100 && high.services < total * 75 / 100);
+    CHECK(medium.services > total * 15 / 100 && medium.services < total * 25 / 100);
+    CHECK(low.services > total * 5 / 100 && low.services < total * 15 / 100);
+
+    printf("%u / %u / %u\n", high.services, medium.services, low.services);
+
+    high.destroy();
+    medium.destroy();
+    low.destroy();
+    sched.run();
+
+    return CHECK_RESULT();
+}
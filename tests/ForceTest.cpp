@@ -0,0 +1,77 @@
+/*
+* ForceTest.cpp
+* force() wakes a SERVICE_ON_EVENT process, even when the job queue is full
+* Built with a tiny job queue, and also with _PROCESS_LINEAR_SCAN
+*/
+
+#include <ProcessScheduler.h>
+#include "Check.h"
+
+class CountProcess : public Process
+{
+public:
+    CountProcess(Scheduler &manager, uint32_t period)
+        :  Process(manager, HIGH_PRIORITY, period) {}
+
+    int services = 0;
+
+protected:
+    virtual void service() { services++; }
+};
+
+#define FILLERS (SCHEDULER_JOB_QUEUE_SIZE + 1)
+
+static Scheduler sched;
+
+// Only there to take up slots in the job queue
+class FillerProcess : public CountProcess
+{
+public:
+    FillerProcess() :  CountProcess(sched, 1000) {}
+};
+
+static FillerProcess fillers[FILLERS];
+
+int main()
+{
+    CountProcess waiter(sched, SERVICE_ON_EVENT);
+
+    waiter.add(true);
+    for (int i = 0; i < FILLERS; i++) {
+        fillers[i].add(true);
+        sched.run();
+    }
+
+    for (int i = 0; i < 5; i++)
+        sched.run();
+    CHECK(waiter.services == 0);
+
+    // Woken up with room in the queue
+    waiter.force();
+    sched.run();
+    CHECK(waiter.services == 1);
+
+    // Fill the queue, each filler takes its own slot
+    int queued = 0;
+    while (queued < FILLERS && fillers[queued].disable())
+        queued++;
+    CHECK(queued == SCHEDULER_JOB_QUEUE_SIZE);
+
+    // No room for its job, it still has to run
+    waiter.force();
+    sched.run();
+    sched.run();
+    CHECK(waiter.services == 2);
+
+    // Only once
+    for (int i = 0; i < 5; i++)
+        sched.run();
+    CHECK(waiter.services == 2);
+
+    waiter.destroy();
+    for (int i = 0; i < FILLERS; i++)
+        fillers[i].destroy();
+    sched.run();
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,52 @@
+/*
+* IdleTest.cpp
+* runOrSleep() on POSIX sleeps only until the next process is due, so a
+* period under 1 ms (with _MICROS_PRECISION) does not idle a whole ms
+*/
+
+#include <ProcessScheduler.h>
+#include "Check.h"
+
+#define PERIOD 300
+#define SERVICES 20
+
+class CountProcess : public Process
+{
+public:
+    CountProcess(Scheduler &manager)
+        :  Process(manager, HIGH_PRIORITY, PERIOD) {}
+
+    int services = 0;
+
+protected:
+    virtual void service() { services++; }
+};
+
+int main()
+{
+    Scheduler sched;
+    CountProcess p(sched);
+    p.add(true);
+    sched.run(); // Add it
+
+    // The shortest time runOrSleep() idled, noise on a busy machine only makes it longer
+    uint32_t shortest = UINT32_MAX;
+    uint32_t start = micros();
+    while (p.services < SERVICES && micros() - start < 1000000)
+    {
+        uint32_t before = micros();
+        if (!sched.runOrSleep()) {
+            uint32_t idled = micros() - before;
+            if (idled < shortest)
+                shortest = idled;
+        }
+    }
+
+    CHECK(p.services == SERVICES);
+    CHECK(shortest < PERIOD * 2);
+
+    p.destroy();
+    sched.run();
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,107 @@
+/*
+* JobQueueStress.cpp
+* Several producer threads add() to one JobQueue while a single consumer pulls,
+* every job has to come out exactly once, and in order for each producer
+*
+* usage: test_job_queue_stress [producers] [jobs per producer]
+*/
+
+#include <ProcessScheduler.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "Check.h"
+
+#define QUEUE_SIZE 16
+
+// Which producer in the top byte, its count in the rest
+typedef uint32_t Job;
+#define JOB(producer, n) (((Job)(producer) << 24) | (n))
+
+static JobQueue<Job, QUEUE_SIZE> queue;
+
+static void produce(uint32_t producer, uint32_t jobs, uint32_t *full)
+{
+    for (uint32_t n = 0; n < jobs; n++)
+    {
+        // Mostly spin, so a producer gets preempted anywhere in add(), even on one core
+        while (!queue.add(JOB(producer, n)))
+        {
+            if (!(++(*full) % 64))
+                std::this_thread::yield();
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t producers = argc > 1 ? strtoul(argv[1], NULL, 10) : 4;
+    uint32_t jobs = argc > 2 ? strtoul(argv[2], NULL, 10) : 200000;
+    if (!producers || producers > 255 || jobs > 0xFFFFFF) {
+        printf("usage: %s [producers (1-255)] [jobs per producer (< 2^24)]\n", argv[0]);
+        return 2;
+    }
+
+    std::vector<uint32_t> next(producers, 0), full(producers, 0);
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; p++)
+        threads.push_back(std::thread(produce, p, jobs, &full[p]));
+
+    uint32_t pulled = 0, duplicated = 0, skipped = 0, bogus = 0, overfull = 0;
+    std::chrono::steady_clock::time_point lastPull = std::chrono::steady_clock::now();
+    while (pulled < producers * jobs)
+    {
+        if (queue.count() > QUEUE_SIZE)
+            overfull++;
+
+        Job job;
+        if (!queue.pull(job)) {
+            // A lost job never shows up, give up on it eventually
+            if (std::chrono::steady_clock::now() - lastPull > std::chrono::seconds(5)) {
+                printf("Nothing pulled for 5 seconds, %u jobs missing\n", producers * jobs - pulled);
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        lastPull = std::chrono::steady_clock::now();
+        pulled++;
+
+        uint32_t p = job >> 24, n = job & 0xFFFFFF;
+        if (p >= producers || n >= jobs)
+            bogus++;
+        else if (n < next[p])
+            duplicated++; // Already seen, or out of order
+        else if (n > next[p])
+            skipped++; // One before it never came out
+        next[p] = n + 1;
+    }
+
+    // Producers stuck on a full queue would never finish
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        if (pulled == producers * jobs)
+            threads[i].join();
+        else
+            threads[i].detach();
+    }
+
+    uint32_t totalFull = 0;
+    for (uint32_t p = 0; p < producers; p++)
+    {
+        CHECK(next[p] == jobs);
+        totalFull += full[p];
+    }
+
+    Job extra;
+    CHECK(!queue.pull(extra));
+    CHECK(queue.isEmpty());
+    CHECK(bogus == 0);
+    CHECK(duplicated == 0);
+    CHECK(skipped == 0);
+    CHECK(overfull == 0);
+
+    printf("%u producers, %u jobs, queue was full %u times\n", producers, pulled, totalFull);
+    return CHECK_RESULT();
+}
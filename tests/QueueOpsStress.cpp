@@ -0,0 +1,169 @@
+/*
+* QueueOpsStress.cpp
+* Several threads enable(), disable() and force() real processes while the main thread
+* calls run(), so queued operations are claimed, merged and applied concurrently
+* (threads stand in for interrupts). Each thread owns the enable()/disable() of a few
+* processes, and force()s any of them. Once all is applied, each process has to end up
+* in the state its owner left it, every force() on an enabled process has to be serviced,
+* and nothing can be applied more often than it was asked for
+*
+* usage: test_queue_ops_stress [threads] [operations per thread]
+*/
+
+#include <ProcessScheduler.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "Check.h"
+
+#define PROCS_PER_THREAD 4
+#define MAX_THREADS 8
+
+class StressProcess final : public Process
+{
+public:
+    StressProcess(Scheduler &manager)
+        :  Process(manager, HIGH_PRIORITY, SERVICE_ON_EVENT) {}
+
+    std::atomic<bool> needService{false}; // Set before each force()
+    std::atomic<uint32_t> services{0};
+    uint32_t enables = 0, disables = 0; // What was applied, only the main thread touches these
+    std::atomic<uint32_t> calls{0}; // enable()s and disable()s that returned true
+
+protected:
+    virtual void service()
+    {
+        needService = false;
+        services++;
+        // Applied only while enabled
+        if (!isEnabled())
+            badService = true;
+    }
+
+    virtual void onEnable() { enables++; }
+    virtual void onDisable() { disables++; }
+
+public:
+    static std::atomic<bool> badService;
+};
+
+std::atomic<bool> StressProcess::badService{false};
+
+static std::vector<StressProcess *> procs;
+static std::atomic<uint32_t> forces{0}, failed{0};
+
+static uint32_t nextRandom(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void forceOne(StressProcess &p)
+{
+    p.needService = true;
+    p.force();
+    forces++;
+}
+
+static void hammer(uint32_t thread, uint32_t ops)
+{
+    uint32_t state = 0x9E3779B9 * (thread + 1);
+    StressProcess **own = &procs[thread * PROCS_PER_THREAD];
+
+    for (uint32_t n = 0; n < ops; n++)
+    {
+        uint32_t r = nextRandom(state);
+        StressProcess &p = *own[r % PROCS_PER_THREAD];
+
+        if (r & 0x100) {
+            bool ok = (r & 0x200) ? p.enable() : p.disable();
+            if (ok)
+                p.calls++;
+            else
+                failed++;
+        }
+
+        // Never yield, so a thread gets preempted anywhere in queuePending(), even on one core
+        forceOne(*procs[(r >> 12) % procs.size()]);
+    }
+
+    // Leave the even ones enabled and the odd ones disabled, retrying on a full queue
+    for (uint32_t i = 0; i < PROCS_PER_THREAD; i++)
+    {
+        StressProcess &p = *own[i];
+        while (!((i % 2) ? p.disable() : p.enable()))
+            std::this_thread::yield();
+        p.calls++;
+        forceOne(p);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t threadCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 4;
+    uint32_t ops = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+    if (!threadCount || threadCount > MAX_THREADS) {
+        printf("usage: %s [threads (1-%d)] [operations per thread]\n", argv[0], MAX_THREADS);
+        return 2;
+    }
+
+    Scheduler sched;
+    for (uint32_t i = 0; i < threadCount * PROCS_PER_THREAD; i++)
+    {
+        procs.push_back(new StressProcess(sched));
+        procs.back()->add();
+        sched.run();
+    }
+
+    std::atomic<uint32_t> done{0};
+    std::vector<std::thread> threads;
+    for (uint32_t t = 0; t < threadCount; t++)
+        threads.push_back(std::thread([t, ops, &done]() { hammer(t, ops); done++; }));
+
+    while (done < threadCount)
+    {
+        sched.run();
+        std::this_thread::yield();
+    }
+
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    // Apply what is left, and service what that made due
+    for (int i = 0; i < 4; i++)
+        while (sched.run());
+
+    uint32_t services = 0;
+    for (size_t i = 0; i < procs.size(); i++)
+    {
+        StressProcess &p = *procs[i];
+        bool enabled = !(i % 2);
+
+        CHECK(p.isEnabled() == enabled);
+        // Every change was applied once, starting from disabled
+        CHECK(p.enables - p.disables == (enabled ? 1u : 0u));
+        CHECK(p.enables + p.disables <= p.calls);
+        // The last force() was not lost
+        if (enabled)
+            CHECK(!p.needService);
+        services += p.services;
+    }
+
+    CHECK(!StressProcess::badService);
+    CHECK(services > 0);
+    CHECK(services <= forces);
+
+    printf("%u threads, %u forces, %u services, %u operations refused on a full queue\n",
+        threadCount, (unsigned)forces, services, (unsigned)failed);
+
+    for (size_t i = 0; i < procs.size(); i++)
+        procs[i]->destroy();
+    sched.run();
+    for (size_t i = 0; i < procs.size(); i++)
+        delete procs[i];
+
+    return CHECK_RESULT();
+}
@@ -0,0 +1,126 @@
+/*
+* StackfulTest.cpp
+* StackfulProcess: yield() takes turns, sleepFor() waits on the clock, and
+* destroying a suspended task() drops the rest of that iteration
+*/
+
+#include <ProcessScheduler.h>
+#include <string.h>
+#include "Check.h"
+
+#define STACK_SIZE 16384
+
+static char steps[64];
+
+static void step(char c)
+{
+    size_t len = strlen(steps);
+    if (len + 1 < sizeof(steps)) {
+        steps[len] = c;
+        steps[len + 1] = 0;
+    }
+}
+
+// Runs once: first, yield(), second, sleepFor(100), third
+class StepProcess : public StackfulProcess
+{
+public:
+    StepProcess(Scheduler &manager, const char *names)
+        :  StackfulProcess(manager, HIGH_PRIORITY, SERVICE_CONSTANTLY, _stack, STACK_SIZE, 1),
+        _names(names) {}
+
+protected:
+    virtual void task()
+    {
+        step(_names[0]);
+        yield();
+        step(_names[1]);
+        sleepFor(100);
+        step(_names[2]);
+    }
+
+private:
+    const char *_names;
+    uint8_t _stack[STACK_SIZE];
+};
+
+// Uses up some stack, to see it in the high water mark
+static uint32_t recurse(volatile uint8_t *prev, uint8_t depth)
+{
+    volatile uint8_t buf[64];
+    buf[0] = prev ? prev[0] + 1 : 0;
+    return depth ? recurse(buf, depth - 1) + buf[0] : buf[0];
+}
+
+class DeepProcess : public StackfulProcess
+{
+public:
+    DeepProcess(Scheduler &manager)
+        :  StackfulProcess(manager, HIGH_PRIORITY, SERVICE_CONSTANTLY, _stack, STACK_SIZE, 1) {}
+
+    uint32_t result = 0;
+
+protected:
+    virtual void task() { result = recurse(NULL, 32); }
+
+private:
+    uint8_t _stack[STACK_SIZE];
+};
+
+static void runFor(Scheduler &sched, VirtualClock &clock, uint32_t time)
+{
+    for (uint32_t i = 0; i < time; i++)
+    {
+        sched.run();
+        clock.advance(1);
+    }
+}
+
+int main()
+{
+    VirtualClock clock;
+    Scheduler::setClock(&clock);
+    Scheduler sched;
+
+    StepProcess a(sched, "ABC"), b(sched, "abc");
+    a.add(true);
+    b.add(true);
+    sched.run(); // Add them
+
+    // Both pick up after their yield(), then sleep
+    runFor(sched, clock, 10);
+    CHECK(!strcmp(steps, "AaBb"));
+    CHECK(a.isSuspended());
+    CHECK(b.isSuspended());
+
+    runFor(sched, clock, 100);
+    CHECK(!strcmp(steps, "AaBbCc"));
+    CHECK(!a.isSuspended());
+    CHECK(a.getIterations() == 0);
+
+    // The rest of the iteration is dropped
+    steps[0] = 0;
+    a.setIterations(1);
+    a.restart();
+    runFor(sched, clock, 10);
+    CHECK(!strcmp(steps, "AB"));
+    a.destroy();
+    runFor(sched, clock, 200);
+    CHECK(!strcmp(steps, "AB"));
+    CHECK(!a.isSuspended());
+
+    DeepProcess deep(sched);
+    CHECK(deep.getStackHighWaterMark() < 256);
+    deep.add(true);
+    runFor(sched, clock, 5);
+    CHECK(deep.result > 0);
+    CHECK(deep.getStackHighWaterMark() >= 32 * 64);
+    CHECK(deep.getStackHighWaterMark() < STACK_SIZE);
+
+    b.destroy();
+    deep.destroy();
+    sched.run();
+    Scheduler::setClock(NULL);
+
+    return CHECK_RESULT();
+}
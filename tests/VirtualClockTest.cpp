@@ -0,0 +1,57 @@
+/*
+* VirtualClockTest.cpp
+* runOrSleep() with a VirtualClock jumps to the next process due, and stays put when nothing is scheduled
+*/
+
+#include <ProcessScheduler.h>
+#include "Check.h"
+
+class CountProcess : public Process
+{
+public:
+    CountProcess(Scheduler &manager, uint32_t period)
+        :  Process(manager, HIGH_PRIORITY, period) {}
+
+    int services = 0;
+
+protected:
+    virtual void service() { services++; }
+};
+
+int main()
+{
+    VirtualClock clock(1000);
+    Scheduler::setClock(&clock);
+    Scheduler sched;
+
+    // Nothing scheduled, the time must not jump ahead (and wrap around)
+    CHECK(sched.timeUntilNextRun() == NEXT_RUN_NEVER);
+    for (int i = 0; i < 3; i++)
+        sched.runOrSleep();
+    CHECK(Scheduler::getCurrTS() == 1000);
+
+    CountProcess proc(sched, 100);
+    proc.add(true);
+    sched.run();
+    CHECK(proc.services == 0); // First due a period after it was added
+
+    // Sleeps straight to the next period
+    for (int i = 0; i < 10; i++)
+        sched.runOrSleep();
+    CHECK(proc.services == 5);
+    CHECK(Scheduler::getCurrTS() == 1500);
+
+    // Disabled, nothing left to wait for
+    proc.disable();
+    sched.run();
+    uint32_t before = Scheduler::getCurrTS();
+    for (int i = 0; i < 3; i++)
+        sched.runOrSleep();
+    CHECK(Scheduler::getCurrTS() == before);
+
+    proc.destroy();
+    sched.run();
+    Scheduler::setClock(NULL);
+
+    return CHECK_RESULT();
+}